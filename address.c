@@ -0,0 +1,72 @@
+/*
+ * Source address cache
+ *
+ * Keeps the "[ip:port]" fragment of the log line prefix for recent senders,
+ * so it does not have to be formatted for every datagram. The cache is
+ * direct mapped and indexed by a multiplicative hash of the raw address and
+ * port, a colliding sender simply replaces the entry.
+ *
+ * File:   address.c
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+
+#include "address.h"
+
+// provided by yaul.c
+extern unsigned int stat_address_hits;
+extern unsigned int stat_address_misses;
+
+// Cached fragment of one sender, 32 bytes
+struct addressEntry {
+	uint32_t addr;						// address in network byte order
+	uint16_t port;						// port in network byte order
+	uint8_t len;						// length of text, 0 = unused
+	char text[ADDRESS_LENGTH];
+};
+
+static struct addressEntry cache[ADDRESS_CACHE];
+
+/**
+ * Preformatted "[ip:port]" of a sender, valid until the next call
+ *
+ * @param const struct sockaddr_in * addr
+ * @param size_t * len length of the returned string
+ * @return const char *
+ */
+const char * addressFormat(const struct sockaddr_in *addr, size_t *len) {
+	struct addressEntry *entry;
+	char ip[INET_ADDRSTRLEN];
+	uint64_t key;
+
+	// Fibonacci hashing, the top bits of the product depend on all key bits
+	key = addr->sin_addr.s_addr | (uint64_t) addr->sin_port << 32;
+	entry = &cache[(key * 0x9e3779b97f4a7c15ull) >> (64 - ADDRESS_CACHE_BITS)];
+
+	if (entry->len == 0 || entry->addr != addr->sin_addr.s_addr || entry->port != addr->sin_port) {
+		inet_ntop(AF_INET, &addr->sin_addr, ip, sizeof(ip));
+		entry->len = snprintf(entry->text, sizeof(entry->text), "[%s:%u]", ip, ntohs(addr->sin_port));
+		entry->addr = addr->sin_addr.s_addr;
+		entry->port = addr->sin_port;
+		stat_address_misses++;
+	} else {
+		stat_address_hits++;
+	}
+
+	*len = entry->len;
+	return entry->text;
+}
+
+#ifdef	__cplusplus
+}
+#endif
@@ -0,0 +1,31 @@
+/* 
+ * Source address cache header
+ * 
+ * File:   address.h
+ * Author: Andreas Behringer
+ * 
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifndef ADDRESS_H
+#define	ADDRESS_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <netinet/in.h>
+
+#define ADDRESS_CACHE_BITS 10
+#define ADDRESS_CACHE (1 << ADDRESS_CACHE_BITS)	// entries of the address cache
+#define ADDRESS_LENGTH 24				// "[255.255.255.255:65535]" plus NUL
+
+const char * addressFormat(const struct sockaddr_in *addr, size_t *len);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* ADDRESS_H */
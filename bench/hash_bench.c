@@ -0,0 +1,172 @@
+/*
+ * Quality and throughput of the logname hash functions
+ *
+ * Every hash runs over the same sets of lognames. Quality is measured the way
+ * the logname tables use the hash, by the low bits of power of two table
+ * sizes: the sum of squared bucket loads against the one expected from a
+ * random function (1.00 is ideal, higher means longer probes) and the number
+ * of full 32 bit collisions.
+ *
+ * File:   hash_bench.c
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../config.h"
+#include "../hash.h"
+
+#define NAMES 65536
+#define ROUNDS 100
+
+static char (*names)[NAMELENGTH];
+static size_t *lengths;
+static unsigned int *hashes;
+
+/**
+ * Nanoseconds of monotonic clock
+ * @return double
+ */
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned int djb2(const char *key, size_t len) {
+	return djb2Hash((void *) key);
+}
+
+static unsigned int sdbm(const char *key, size_t len) {
+	return sdbmHash((void *) key);
+}
+
+static const struct {
+	const char *name;
+	unsigned int (*fn)(const char *key, size_t len);
+} functions[] = {
+	{ "djb2", djb2 },
+	{ "sdbm", sdbm },
+	{ "wyhash", wyHash },
+};
+
+/**
+ * Fill name set number set
+ * @param int set
+ * @return const char * description of the set
+ */
+static const char * createNames(int set) {
+	static const char *apps[] = { "app", "billing", "search", "checkout", "auth", "media" };
+	static const char *parts[] = { "web", "api", "worker", "cron", "db.replication", "frontend.render" };
+	unsigned int i;
+
+	for (i = 0; i < NAMES; i++) {
+		switch (set) {
+			case 0:
+				sprintf(names[i], "%s.%s.%s%u", apps[i % 6], parts[i / 6 % 6], i % 3 ? "node" : "", i);
+				break;
+			case 1:
+				sprintf(names[i], "log%u", i);
+				break;
+			default:
+				sprintf(names[i], "web%02u.%s.prod.euwest%u.example.com.access", i % 100, apps[i / 100 % 6], i / 600);
+				break;
+		}
+		lengths[i] = strlen(names[i]);
+	}
+
+	return set == 0 ? "services" : (set == 1 ? "numbered" : "hostnames");
+}
+
+/**
+ * Sum of squared bucket loads relative to a random function
+ * @param unsigned int bits table size is 1 << bits
+ * @return double
+ */
+static double bucketScore(unsigned int bits) {
+	unsigned int *buckets;
+	unsigned int i, size = 1u << bits;
+	double sum = 0, load = (double) NAMES / size;
+
+	buckets = calloc(size, sizeof(unsigned int));
+	for (i = 0; i < NAMES; i++) {
+		buckets[hashes[i] & (size - 1)]++;
+	}
+	for (i = 0; i < size; i++) {
+		sum += (double) buckets[i] * buckets[i];
+	}
+	free(buckets);
+
+	// expectation of the sum for uniformly random hashes
+	return sum / (NAMES * (load + 1 - 1.0 / size));
+}
+
+static int cmpHash(const void *a, const void *b) {
+	unsigned int x = *(const unsigned int *) a, y = *(const unsigned int *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/**
+ * Number of names sharing their full hash with a name before them
+ * @return unsigned int
+ */
+static unsigned int collisions(void) {
+	unsigned int i, n = 0;
+
+	qsort(hashes, NAMES, sizeof(unsigned int), cmpHash);
+	for (i = 1; i < NAMES; i++) {
+		n += hashes[i] == hashes[i - 1];
+	}
+
+	return n;
+}
+
+int main(int argc, char **argv) {
+	unsigned int i, r, f, sum = 0;
+	const char *setname;
+	double start, ns;
+	size_t bytes;
+	int set;
+
+	names = malloc(NAMES * sizeof(*names));
+	lengths = malloc(NAMES * sizeof(size_t));
+	hashes = malloc(NAMES * sizeof(unsigned int));
+
+	printf("%-10s %-8s %8s %8s %10s %10s %10s\n", "names", "hash", "ns/name", "GB/s", "load 2^10", "load 2^16", "collisions");
+	for (set = 0; set < 3; set++) {
+		setname = createNames(set);
+		for (bytes = 0, i = 0; i < NAMES; i++) {
+			bytes += lengths[i];
+		}
+		for (f = 0; f < sizeof(functions) / sizeof(functions[0]); f++) {
+			start = now();
+			for (r = 0; r < ROUNDS; r++) {
+				for (i = 0; i < NAMES; i++) {
+					sum += functions[f].fn(names[i], lengths[i]);
+				}
+			}
+			ns = now() - start;
+			for (i = 0; i < NAMES; i++) {
+				hashes[i] = functions[f].fn(names[i], lengths[i]);
+			}
+			printf("%-10s %-8s %8.1f %8.2f %10.2f %10.2f",
+					setname, functions[f].name,
+					ns / ((double) ROUNDS * NAMES),
+					(double) bytes * ROUNDS / ns,
+					bucketScore(10), bucketScore(16));
+			// sorts the hashes, so only after the bucket scores
+			printf(" %10u\n", collisions());
+		}
+	}
+	printf("(%u names per set, checksum %u)\n", NAMES, sum);
+
+	return 0;
+}
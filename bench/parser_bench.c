@@ -0,0 +1,109 @@
+/*
+ * Microbenchmark of the message parser against the former sscanf path
+ *
+ * File:   parser_bench.c
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../config.h"
+#include "../parser.h"
+
+#define MESSAGES 64
+#define ROUNDS 200000
+
+static char messages[MESSAGES][BUF];
+static size_t lengths[MESSAGES];
+
+/**
+ * Nanoseconds of monotonic clock
+ * @return double
+ */
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Fill message set with typical log lines, every 8th without logname
+ */
+static void createMessages(void) {
+	static const char *names[] = { "app", "app.web.frontend", "billing.worker17", "db.replication.lag.checker" };
+	int i, n;
+
+	for (i = 0; i < MESSAGES; i++) {
+		if (i % 8 == 7) {
+			n = sprintf(messages[i], "plain message without logname number %d", i);
+		} else {
+			n = sprintf(messages[i], "[%s]GET /api/v2/items/%d?expand=owner,tags HTTP/1.1 200 %dms user=%d agent=\"Mozilla/5.0 (X11; Linux x86_64)\"",
+					names[i % 4], i * 7919, i % 97, i * 31);
+		}
+		// some messages carry a second line that is cut off
+		if (i % 5 == 0) {
+			n += sprintf(messages[i] + n, "\n  at frame %d", i);
+		}
+		lengths[i] = n;
+	}
+}
+
+int main(int argc, char **argv) {
+	char buffer[BUF + 1];
+	char name[NAMELENGTH];
+	parsedMessage msg;
+	double start, sscanf_ns, parser_ns;
+	unsigned long sum = 0;
+	int i, r;
+
+	createMessages();
+
+	// both paths must agree before timing them
+	for (i = 0; i < MESSAGES; i++) {
+		memcpy(buffer, messages[i], lengths[i]);
+		buffer[lengths[i]] = '\0';
+		parseMessage(messages[i], lengths[i], &msg);
+		if (sscanf(buffer, "[%[a-zA-Z0-9.]]%[^\n]", name, buffer) == 2
+				&& (msg.namelen != strlen(name) || memcmp(msg.name, name, msg.namelen) != 0
+				|| msg.bodylen != strlen(buffer) || memcmp(msg.body, buffer, msg.bodylen) != 0)) {
+			printf("Mismatch on message %d\n", i);
+			return 1;
+		}
+	}
+
+	// former path: terminate copy of receive buffer, then sscanf in place
+	start = now();
+	for (r = 0; r < ROUNDS; r++) {
+		for (i = 0; i < MESSAGES; i++) {
+			memcpy(buffer, messages[i], lengths[i]);
+			buffer[lengths[i]] = '\0';
+			if (sscanf(buffer, "[%[a-zA-Z0-9.]]%[^\n]", name, buffer) != 2) {
+				strcpy(name, "yaul");
+			}
+			sum += name[0] + buffer[0];
+		}
+	}
+	sscanf_ns = (now() - start) / ((double) ROUNDS * MESSAGES);
+
+	start = now();
+	for (r = 0; r < ROUNDS; r++) {
+		for (i = 0; i < MESSAGES; i++) {
+			parseMessage(messages[i], lengths[i], &msg);
+			sum += msg.namelen + msg.bodylen;
+		}
+	}
+	parser_ns = (now() - start) / ((double) ROUNDS * MESSAGES);
+
+	printf("sscanf:      %8.1f ns/message\n", sscanf_ns);
+	printf("parseMessage:%8.1f ns/message\n", parser_ns);
+	printf("speedup:     %8.1fx (checksum %lu)\n", sscanf_ns / parser_ns, sum);
+
+	return 0;
+}
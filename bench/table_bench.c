@@ -0,0 +1,153 @@
+/*
+ * Microbenchmark of the logname table against the chained hashtable
+ *
+ * Built twice, linked with hashtable/hashtable.c (prime table sizes) and
+ * with hashtable/hashtable_powers.c (power of two sizes), as both provide
+ * the same functions.
+ *
+ * File:   table_bench.c
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../config.h"
+#include "../hash.h"
+#include "../nametable.h"
+#include "../hashtable/hashtable.h"
+
+#ifndef TABLE
+#define TABLE "hashtable"
+#endif
+
+#define LOOKUPS 4000000
+#define CHURN 400000
+
+static char (*names)[NAMELENGTH];
+static unsigned int *sequence;
+
+/**
+ * Nanoseconds of monotonic clock
+ * @return double
+ */
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Compare function for hashtable key comparison, as used by yaul before
+ * @param void * a
+ * @param void * b
+ * @return int
+ */
+static int cmpKeys(void *a, void *b) {
+	return (0 == strcmp(a, b));
+}
+
+/**
+ * Fill name set with dotted lognames of services, hosts and workers, and a
+ * skewed lookup sequence where a few lognames carry most messages
+ * @param unsigned int count
+ */
+static void createNames(unsigned int count) {
+	static const char *apps[] = { "app", "billing", "search", "checkout", "auth", "media" };
+	static const char *parts[] = { "web", "api", "worker", "cron", "db.replication", "frontend.render" };
+	unsigned int i, r;
+
+	names = malloc(count * sizeof(*names));
+	for (i = 0; i < count; i++) {
+		sprintf(names[i], "%s.%s.%s%u", apps[i % 6], parts[i / 6 % 6], i % 3 ? "node" : "", i);
+	}
+	sequence = malloc(LOOKUPS * sizeof(unsigned int));
+	srand(42);
+	for (i = 0; i < LOOKUPS; i++) {
+		r = rand();
+		// half of the traffic goes to an eighth of the lognames
+		sequence[i] = (r & 1) ? (r >> 1) % (count / 8 + 1) : (r >> 1) % count;
+	}
+}
+
+/**
+ * Time lookups and remove/insert churn with a table of count lognames
+ * @param unsigned int count
+ */
+static void run(unsigned int count) {
+	struct hashtable *h;
+	nametable *t;
+	double start, hashtable_ns, nametable_ns, hashtable_churn, nametable_churn;
+	unsigned long sum = 0;
+	unsigned int i, n;
+	char *key;
+
+	createNames(count);
+	h = create_hashtable(count, djb2Hash, cmpKeys);
+	t = nametableCreate(count);
+	for (i = 0; i < count; i++) {
+		hashtable_insert(h, strdup(names[i]), names[i]);
+		nametableInsert(t, names[i], strlen(names[i]), djb2Hash(names[i]), names[i]);
+	}
+
+	// both must find the same values before timing them
+	for (i = 0; i < count; i++) {
+		if (hashtable_search(h, names[i]) != nametableSearch(t, names[i], strlen(names[i]), djb2Hash(names[i]))) {
+			printf("Mismatch on %s\n", names[i]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	start = now();
+	for (i = 0; i < LOOKUPS; i++) {
+		sum += (unsigned long) hashtable_search(h, names[sequence[i]]);
+	}
+	hashtable_ns = (now() - start) / LOOKUPS;
+
+	start = now();
+	for (i = 0; i < LOOKUPS; i++) {
+		key = names[sequence[i]];
+		sum += (unsigned long) nametableSearch(t, key, strlen(key), djb2Hash(key));
+	}
+	nametable_ns = (now() - start) / LOOKUPS;
+
+	// evict and reopen like the handle cache does when it is full
+	start = now();
+	for (i = 0; i < CHURN; i++) {
+		n = sequence[i];
+		// frees the duplicated key
+		hashtable_remove(h, names[n]);
+		hashtable_insert(h, strdup(names[n]), names[n]);
+	}
+	hashtable_churn = (now() - start) / CHURN;
+
+	start = now();
+	for (i = 0; i < CHURN; i++) {
+		key = names[sequence[i]];
+		nametableRemove(t, key, strlen(key), djb2Hash(key));
+		nametableInsert(t, key, strlen(key), djb2Hash(key), key);
+	}
+	nametable_churn = (now() - start) / CHURN;
+
+	printf("%5u names  search: %-18s %6.1f ns  nametable %6.1f ns  remove+insert: %-18s %6.1f ns  nametable %6.1f ns (%lu)\n",
+			count, TABLE, hashtable_ns, nametable_ns, TABLE, hashtable_churn, nametable_churn, sum & 1);
+
+	hashtable_destroy(h, 0);
+	nametableDestroy(t);
+	free(names);
+	free(sequence);
+}
+
+int main(int argc, char **argv) {
+	run(MAXHANDLES);
+	run(1000);
+	run(20000);
+
+	return 0;
+}
@@ -15,6 +15,8 @@ extern "C" {
 #endif
 	
 #include <getopt.h>
+#include <errno.h>
+#include <limits.h>
 #include <string.h>
 #include <time.h>
 #include <stdio.h>
@@ -41,12 +43,28 @@ void print_usage(void) {
 -b, --bind=IP              bind to ip address (default %s)\n\
 -l, --logpath=PATH         logging to path (default %s)\n\
 -s, --statistics=FREQUENCY log statistics to file yaul.stat after every [frequency] logmessage\n\
--f, --flush=FREQUENCY      flush output stream after every [frequency] logmessage\n\
+-f, --flush=FREQUENCY      flush output stream after every [frequency] logmessage, 0 = never (default %u, 0 with --flush-interval)\n\
+-F, --flush-interval=MS    flush every logfile with buffered lines every MS milliseconds, also when idle\n\
+-c, --flush-bytes=BYTES    flush logfile as soon as BYTES are buffered for it\n\
+-B, --buffer=BYTES         append buffer per logfile, lines are written when it is full or flushed (default %u)\n\
 -r, --redis-ip=IP          connect to redis server at IP and implicit enable logging to redis (default %s)\n\
 -o, --redis-port=PORT      connect to redis server at PORT and implicit enable logging to redis (default %u)\n\
--t, --redis-ttl=TTL        the TTL in seconds of the dayly lists in redis, starting on last log message added, 0 = persist\n\
+-t, --redis-ttl=TTL        the TTL in seconds of the dayly lists in redis, counted from the end of their day, 0 = persist\n\
+-k, --redis-batch=NUM      send the redis commands for up to NUM lines at once (default %u, max %u)\n\
+-L, --redis-latency=MS     send queued redis commands and read replies at least every MS milliseconds (default %u)\n\
+-Q, --redis-window=NUM     drop messages while NUM redis commands wait for their reply (default %u, max %u)\n\
 -m, --max-handles=NUM      maximum number of opened files (default %u)\n\
--v, --version              display version information\n", PORT, ADDRESS, LOGPATH, config.redis_ip, config.redis_port, MAXHANDLES);
+-N, --max-names=NUM        maximum number of distinct lognames kept per worker, all are forgotten when exceeded (default %u)\n\
+-n, --batch=NUM            receive up to NUM datagrams per syscall, adapts to load (default %u, max %u)\n\
+-w, --workers=NUM          start NUM worker processes sharing the port with SO_REUSEPORT (default %u, max %u)\n\
+-a, --affinity             steer datagrams to workers by logname, each logfile is written by one worker only\n\
+-e, --engine=ENGINE        receive engine: socket, uring, packet or xdp, falls back to socket if unsupported (default socket)\n\
+-i, --interface=NAME       capture on interface NAME with the packet engine (default all), required by xdp\n\
+-T, --timestamp=PRECISION  timestamp precision: s, ms or us (default s)\n\
+-q, --queue=SLOTS          receive in one thread and write in another, with a ring of SLOTS datagrams between them (default 0 = one thread, max %u)\n\
+-R, --receivers=NUM        receive with NUM threads per worker, each on its own socket, feeding one writer thread (default %u, max %u)\n\
+-W, --writers=NUM          write logfiles with a pool of NUM threads per worker, one logfile at a time per thread (default %u, max %u)\n\
+-v, --version              display version information\n", PORT, ADDRESS, LOGPATH, FLUSH, FILEBUFFER, config.redis_ip, config.redis_port, REDISBATCH, MAXREDISBATCH, REDISLATENCY, REDISWINDOW, MAXREDISWINDOW, MAXHANDLES, MAXNAMES, BATCH, MAXBATCH, WORKERS, MAXWORKERS, MAXQUEUE, RECEIVERS, MAXRECEIVERS, WRITERS, MAXWRITERS);
 }
 
 /**
@@ -56,14 +74,50 @@ void setDefaultOptions(void) {
 	config.address = ADDRESS;
 	config.logpath = LOGPATH;
 	config.maxhandles = MAXHANDLES;
+	config.maxnames = MAXNAMES;
+	config.buffer_size = FILEBUFFER;
 	config.opt_daemonize = 0;
 	config.opt_flush = FLUSH;
+	config.flush_interval = 0;
+	config.flush_bytes = 0;
+	config.opt_batch = BATCH;
+	config.opt_workers = WORKERS;
+	config.opt_steering = 0;
+	config.opt_engine = ENGINE_SOCKET;
+	config.interface = NULL;
+	config.opt_precision = PRECISION;
+	config.queue_slots = 0;
+	config.opt_receivers = RECEIVERS;
+	config.opt_writers = WRITERS;
 	config.opt_redis = 0;
 	config.opt_statistics = 0;
 	config.port = PORT;
 	config.redis_ip = "127.0.0.1";
 	config.redis_port = 6379;
 	config.redis_ttl = 0;
+	config.redis_batch = REDISBATCH;
+	config.redis_latency = REDISLATENCY;
+	config.redis_window = REDISWINDOW;
+}
+
+/**
+ * Parse the numeric argument of an option, exit if it is no number in range
+ * @param name long name of the option
+ * @param arg argument of the option
+ * @param min smallest allowed value
+ * @param max largest allowed value
+ */
+unsigned int parseNumber(const char *name, const char *arg, long min, long max) {
+	char *end;
+	long value;
+	
+	errno = 0;
+	value = strtol(arg, &end, 10);
+	if (errno != 0 || end == arg || *end != '\0' || value < min || value > max) {
+		fprintf(stderr, "Invalid --%s: %s, expected a number from %ld to %ld\n", name, arg, min, max);
+		exit (EXIT_FAILURE);
+	}
+	return (unsigned int)value;
 }
 
 /**
@@ -74,6 +128,7 @@ void setDefaultOptions(void) {
 void readOptions(int argc, char** argv) {
 	int opt;
 	int opt_index;
+	int flush_set = 0;
 	
 	setDefaultOptions();
 	
@@ -89,7 +144,23 @@ void readOptions(int argc, char** argv) {
 		{"redis-ip", required_argument, 0, 'r'},
 		{"redis-port", required_argument, 0, 'o'},
 		{"redis-ttl", required_argument, 0, 't'},
+		{"redis-batch", required_argument, 0, 'k'},
+		{"redis-latency", required_argument, 0, 'L'},
+		{"redis-window", required_argument, 0, 'Q'},
 		{"max-handles", required_argument, 0, 'm'},
+		{"max-names", required_argument, 0, 'N'},
+		{"batch", required_argument, 0, 'n'},
+		{"workers", required_argument, 0, 'w'},
+		{"affinity", no_argument, 0, 'a'},
+		{"engine", required_argument, 0, 'e'},
+		{"interface", required_argument, 0, 'i'},
+		{"timestamp", required_argument, 0, 'T'},
+		{"buffer", required_argument, 0, 'B'},
+		{"flush-interval", required_argument, 0, 'F'},
+		{"flush-bytes", required_argument, 0, 'c'},
+		{"queue", required_argument, 0, 'q'},
+		{"receivers", required_argument, 0, 'R'},
+		{"writers", required_argument, 0, 'W'},
 		{0, 0, 0, 0}
 	};
 	
@@ -97,7 +168,7 @@ void readOptions(int argc, char** argv) {
     while ((opt = getopt_long(
 			argc, 
 			(char ** const)argv, 
-			"b:dh?p:l:vs:f:r:o:t:m:", 
+			"b:dh?p:l:vs:f:r:o:t:m:n:w:ae:i:T:B:F:c:N:q:R:W:k:L:Q:", 
 			long_options, 
 			&opt_index)) != EOF) {
 		switch (opt) {
@@ -105,7 +176,7 @@ void readOptions(int argc, char** argv) {
 				config.address = optarg;
 				break;
 			case 'p':
-				config.port = atoi(optarg);
+				config.port = parseNumber("port", optarg, 1, 65535);
 				break;
 			case 'v':
 				print_version();
@@ -120,10 +191,17 @@ void readOptions(int argc, char** argv) {
 				strcpy(config.logpath, optarg);
 				break;
 			case 's':
-				config.opt_statistics = atoi(optarg);
+				config.opt_statistics = parseNumber("statistics", optarg, 0, INT_MAX);
 				break;
 			case 'f':
-				config.opt_flush = atoi(optarg);
+				config.opt_flush = parseNumber("flush", optarg, 0, INT_MAX);
+				flush_set = 1;
+				break;
+			case 'F':
+				config.flush_interval = parseNumber("flush-interval", optarg, 0, INT_MAX);
+				break;
+			case 'c':
+				config.flush_bytes = parseNumber("flush-bytes", optarg, 0, INT_MAX);
 				break;
 			case 'd':
 				config.opt_daemonize = 1;
@@ -133,18 +211,110 @@ void readOptions(int argc, char** argv) {
 				config.opt_redis = 1;
 				break;
 			case 'o':
-				config.redis_port = atoi(optarg);
+				config.redis_port = parseNumber("redis-port", optarg, 1, 65535);
 				config.opt_redis = 1;
 				break;
 			case 't':
-				config.redis_ttl = atoi(optarg);
+				config.redis_ttl = parseNumber("redis-ttl", optarg, 0, INT_MAX);
 				config.opt_redis = 1;
 				break;
+			case 'k':
+				config.redis_batch = parseNumber("redis-batch", optarg, 1, MAXREDISBATCH);
+				break;
+			case 'L':
+				config.redis_latency = parseNumber("redis-latency", optarg, 1, INT_MAX);
+				break;
+			case 'Q':
+				config.redis_window = parseNumber("redis-window", optarg, 1, MAXREDISWINDOW);
+				break;
 			case 'm':
-				config.maxhandles = atoi(optarg);
+				config.maxhandles = parseNumber("max-handles", optarg, 1, INT_MAX);
+				break;
+			case 'N':
+				config.maxnames = parseNumber("max-names", optarg, 1, INT_MAX);
+				break;
+			case 'n':
+				config.opt_batch = parseNumber("batch", optarg, 1, MAXBATCH);
+				break;
+			case 'w':
+				config.opt_workers = parseNumber("workers", optarg, 1, MAXWORKERS);
+				break;
+			case 'a':
+				config.opt_steering = 1;
+				break;
+			case 'e':
+				if (strcmp(optarg, "socket") == 0) {
+					config.opt_engine = ENGINE_SOCKET;
+				} else if (strcmp(optarg, "uring") == 0) {
+					config.opt_engine = ENGINE_URING;
+				} else if (strcmp(optarg, "packet") == 0) {
+					config.opt_engine = ENGINE_PACKET;
+				} else if (strcmp(optarg, "xdp") == 0) {
+					config.opt_engine = ENGINE_XDP;
+				} else {
+					fprintf(stderr, "Unknown engine: %s\n", optarg);
+					exit (EXIT_FAILURE);
+				}
+				break;
+			case 'i':
+				config.interface = optarg;
+				break;
+			case 'B':
+				config.buffer_size = parseNumber("buffer", optarg, MINFILEBUFFER, MAXFILEBUFFER);
+				break;
+			case 'q':
+				config.queue_slots = parseNumber("queue", optarg, 0, MAXQUEUE);
+				break;
+			case 'R':
+				config.opt_receivers = parseNumber("receivers", optarg, 1, MAXRECEIVERS);
+				break;
+			case 'W':
+				config.opt_writers = parseNumber("writers", optarg, 1, MAXWRITERS);
+				break;
+			case 'T':
+				if (strcmp(optarg, "s") == 0) {
+					config.opt_precision = 0;
+				} else if (strcmp(optarg, "ms") == 0) {
+					config.opt_precision = 3;
+				} else if (strcmp(optarg, "us") == 0) {
+					config.opt_precision = 6;
+				} else {
+					fprintf(stderr, "Unknown timestamp precision: %s\n", optarg);
+					exit (EXIT_FAILURE);
+				}
 				break;
 		}
     }
+	
+	// with a flush interval lines are no longer flushed by count by default
+	if (config.flush_interval > 0 && !flush_set) {
+		config.opt_flush = 0;
+	}
+	
+	// several receive threads always feed a writer thread, from sockets only
+	if (config.opt_receivers > 1) {
+		if (config.queue_slots == 0) {
+			config.queue_slots = QUEUESLOTS;
+		}
+		if (config.opt_engine != ENGINE_SOCKET) {
+			fprintf(stderr, "Several receive threads need the socket engine, using it\n");
+			config.opt_engine = ENGINE_SOCKET;
+		}
+	}
+	
+	// the writer pool only writes logfiles, behind a writer thread
+	if (config.opt_redis && config.opt_writers > 1) {
+		fprintf(stderr, "The writer pool only writes logfiles, not using it with Redis\n");
+		config.opt_writers = 1;
+	}
+	if (config.opt_writers > 1 && config.queue_slots == 0) {
+		config.queue_slots = QUEUESLOTS;
+	}
+	
+	// every open file needs a logname id
+	if (config.maxnames < config.maxhandles) {
+		config.maxnames = config.maxhandles;
+	}
 }
 	
 #ifdef	__cplusplus
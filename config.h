@@ -22,7 +22,33 @@ extern "C" {
 #define NAMELENGTH 255
 #define PATHLENGTH 2048
 #define MAXHANDLES 50
+#define MAXNAMES 4096
 #define FLUSH 1
+#define FILEBUFFER 65536
+#define MINFILEBUFFER 1024
+#define MAXFILEBUFFER 16777216
+#define BATCH 1
+#define MAXBATCH 1024
+#define WORKERS 1
+#define MAXWORKERS 256
+#define PRECISION 0
+#define MAXQUEUE 1048576
+#define QUEUESLOTS 4096
+#define RECEIVERS 1
+#define MAXRECEIVERS 64
+#define WRITERS 1
+#define MAXWRITERS 64
+#define REDISBATCH 64
+#define MAXREDISBATCH 65536
+#define REDISLATENCY 10
+#define REDISWINDOW 4096
+#define MAXREDISWINDOW 1048576
+
+// Receive engines
+#define ENGINE_SOCKET 0
+#define ENGINE_URING 1
+#define ENGINE_PACKET 2
+#define ENGINE_XDP 3
 
 // The following defines are usually set in Makefile
 #ifndef PORT
@@ -49,14 +75,30 @@ struct yaulConfig {
 	char *address;					// the address the server is bound to
 	unsigned int opt_daemonize;				// option: daemonize server
 	unsigned int opt_statistics;			// option: write statistics
-	unsigned int opt_flush;				// flush logfile buffer every n'th msg
+	unsigned int opt_flush;				// flush logfile buffer every n'th msg, 0 = never
+	unsigned int flush_interval;			// flush dirty logfiles every n ms, 0 = never
+	unsigned int flush_bytes;				// flush logfile once its buffer holds n bytes
 	unsigned int opt_redis;					// log to redis instead of files
+	unsigned int opt_batch;					// max datagrams received per syscall
+	unsigned int opt_workers;				// number of SO_REUSEPORT worker processes
+	unsigned int opt_steering;				// steer datagrams to workers by logname
+	unsigned int opt_engine;				// receive engine, one of ENGINE_*
+	unsigned int opt_precision;				// fraction digits of timestamps: 0, 3 or 6
+	unsigned int queue_slots;				// ring to the writer thread, 0 = no writer thread
+	unsigned int opt_receivers;				// receive threads per worker, each with its own socket
+	unsigned int opt_writers;				// threads writing logfiles per worker, 1 = the parsing one
+	char *interface;						// interface of packet and xdp engine, NULL = all
 	char *redis_ip;				// ip address of redis server
 	int redis_port;						// port of redis server
 	int redis_ttl ;							// ttl of redis message lists
+	unsigned int redis_batch;				// redis commands sent before their replies are read
+	unsigned int redis_latency;				// ms until replies of queued redis commands are read
+	unsigned int redis_window;				// redis commands waiting for their reply at most
 	
 	char *logpath;							// the path to the logfiles
 	unsigned int maxhandles;		// maximum number of opened files
+	unsigned int maxnames;					// maximum number of logname ids
+	unsigned int buffer_size;				// append buffer per logfile in bytes
 };
 
 extern struct yaulConfig config;
@@ -65,6 +107,7 @@ extern struct yaulConfig config;
 void print_version(void);
 void print_usage(void);
 void setDefaultOptions(void);
+unsigned int parseNumber(const char *name, const char *arg, long min, long max);
 void readOptions(int argc, char** argv);
 
 #ifdef	__cplusplus
@@ -14,10 +14,16 @@
 extern "C" {
 #endif
 	
+#include <stdint.h>
 #include <string.h>
 
 #include "hash.h"
 
+// wyhash secrets, odd 64 bit constants with balanced bits
+#define WY_SECRET0 0xa0761d6478bd642full
+#define WY_SECRET1 0xe7037ed1a0b428dbull
+#define WY_SECRET2 0x8ebc6af09c88c6e3ull
+
 /**
  * D.J. Bernsteins hash algorithm
  * 
@@ -54,6 +60,79 @@ unsigned int sdbmHash(void *k) {
 	return h;
 }
 
+/**
+ * Multiply to 128 bit and fold the halves
+ * @param uint64_t a
+ * @param uint64_t b
+ * @return uint64_t
+ */
+static inline uint64_t wyMix(uint64_t a, uint64_t b) {
+	__uint128_t r = (__uint128_t) a * b;
+	
+	return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
+
+/**
+ * Unaligned little endian reads
+ * @param const char * p
+ * @return uint64_t
+ */
+static inline uint64_t wyRead64(const char *p) {
+	uint64_t v;
+	
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static inline uint64_t wyRead32(const char *p) {
+	uint32_t v;
+	
+	memcpy(&v, p, 4);
+	return v;
+}
+
+/**
+ * Word at a time hash after Wang Yi's wyhash
+ * 
+ * Reads the key 8 bytes at a time, keys up to 16 bytes with two overlapping
+ * reads from both ends without a loop, and mixes with 64x64->128 bit
+ * multiplies. All bits of the result are well mixed, so tables may use the
+ * low bits directly.
+ * 
+ * @param const char * key not NUL terminated
+ * @param size_t len
+ * @return unsigned int
+ */
+unsigned int wyHash(const char *key, size_t len) {
+	const char *p = key;
+	uint64_t seed = WY_SECRET0;
+	uint64_t a, b;
+	size_t i = len;
+	
+	if (len <= 16) {
+		if (len >= 4) {
+			a = (wyRead32(p) << 32) | wyRead32(p + ((len >> 3) << 2));
+			b = (wyRead32(p + len - 4) << 32) | wyRead32(p + len - 4 - ((len >> 3) << 2));
+		} else if (len > 0) {
+			a = ((uint64_t) (unsigned char) p[0] << 16) | ((uint64_t) (unsigned char) p[len >> 1] << 8) | (unsigned char) p[len - 1];
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		while (i > 16) {
+			seed = wyMix(wyRead64(p) ^ WY_SECRET1, wyRead64(p + 8) ^ seed);
+			p += 16;
+			i -= 16;
+		}
+		// last 16 bytes, may overlap the ones already mixed
+		a = wyRead64(p + i - 16);
+		b = wyRead64(p + i - 8);
+	}
+	
+	return (unsigned int) wyMix(WY_SECRET1 ^ len, wyMix(a ^ WY_SECRET1, b ^ seed ^ WY_SECRET2));
+}
+
 #ifdef	__cplusplus
 }
 #endif
@@ -17,8 +17,11 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 unsigned int djb2Hash(void *k);
 unsigned int sdbmHash(void *k);
+unsigned int wyHash(const char *key, size_t len);
 
 #ifdef	__cplusplus
 }
@@ -23,6 +23,11 @@ static const unsigned int primes[] = {
 };
 const unsigned int prime_table_length = sizeof(primes)/sizeof(primes[0]);
 const float max_load_factor = 0.65;
+const float min_load_factor = 0.15;
+/* Used buckets of the old table migrated by every insert or remove. Growing
+ * at least doubles the table, so the migration is done long before the new
+ * table reaches its own load limit. */
+const unsigned int rehash_buckets = 8;
 
 /*****************************************************************************/
 struct hashtable *
@@ -45,6 +50,10 @@ create_hashtable(unsigned int minsize,
     memset(h->table, 0, size * sizeof(struct entry *));
     h->tablelength  = size;
     h->primeindex   = pindex;
+    h->minprimeindex = pindex;
+    h->oldtable     = NULL;
+    h->oldtablelength = 0;
+    h->rehashindex  = 0;
     h->entrycount   = 0;
     h->hashfn       = hashf;
     h->eqfn         = eqf;
@@ -67,64 +76,92 @@ hash(struct hashtable *h, void *k)
 }
 
 /*****************************************************************************/
-static int
-hashtable_expand(struct hashtable *h)
+static void
+hashtable_rehash(struct hashtable *h, unsigned int buckets)
 {
-    /* Double the size of the table to accomodate more entries */
-    struct entry **newtable;
+    /* Move the entries of up to 'buckets' used buckets of the old table.
+     * Empty buckets are cheap to skip, up to ten per used bucket, so a
+     * sparse table left behind by compaction is drained quickly too. */
     struct entry *e;
-    struct entry **pE;
-    unsigned int newsize, i, index;
-    /* Check we're not hitting max capacity */
-    if (h->primeindex == (prime_table_length - 1)) return 0;
-    newsize = primes[++(h->primeindex)];
-
-    newtable = (struct entry **)malloc(sizeof(struct entry*) * newsize);
-    if (NULL != newtable)
+    unsigned int index, empty = buckets * 10;
+    while (buckets > 0 && h->rehashindex < h->oldtablelength)
     {
-        memset(newtable, 0, newsize * sizeof(struct entry *));
-        /* This algorithm is not 'stable'. ie. it reverses the list
-         * when it transfers entries between the tables */
-        for (i = 0; i < h->tablelength; i++) {
-            while (NULL != (e = h->table[i])) {
-                h->table[i] = e->next;
-                index = indexFor(newsize,e->h);
-                e->next = newtable[index];
-                newtable[index] = e;
-            }
+        if (NULL == h->oldtable[h->rehashindex])
+        {
+            h->rehashindex++;
+            if (0 == --empty) break;
+            continue;
+        }
+        while (NULL != (e = h->oldtable[h->rehashindex])) {
+            h->oldtable[h->rehashindex] = e->next;
+            index = indexFor(h->tablelength,e->h);
+            e->next = h->table[index];
+            h->table[index] = e;
         }
-        free(h->table);
-        h->table = newtable;
+        h->rehashindex++;
+        buckets--;
     }
-    /* Plan B: realloc instead */
-    else 
+    if (NULL != h->oldtable && h->rehashindex >= h->oldtablelength)
     {
-        newtable = (struct entry **)
-                   realloc(h->table, newsize * sizeof(struct entry *));
-        if (NULL == newtable) { (h->primeindex)--; return 0; }
-        h->table = newtable;
-        memset(newtable[h->tablelength], 0, newsize - h->tablelength);
-        for (i = 0; i < h->tablelength; i++) {
-            for (pE = &(newtable[i]), e = *pE; e != NULL; e = *pE) {
-                index = indexFor(newsize,e->h);
-                if (index == i)
-                {
-                    pE = &(e->next);
-                }
-                else
-                {
-                    *pE = e->next;
-                    e->next = newtable[index];
-                    newtable[index] = e;
-                }
-            }
-        }
+        free(h->oldtable);
+        h->oldtable = NULL;
+        h->oldtablelength = 0;
+        h->rehashindex = 0;
     }
-    h->tablelength = newsize;
-    h->loadlimit   = (unsigned int) ceil(newsize * max_load_factor);
+}
+
+/*****************************************************************************/
+static int
+hashtable_resize(struct hashtable *h, unsigned int pindex)
+{
+    /* Switch to a table of primes[pindex] buckets. The entries are not
+     * moved here but a few buckets at a time by later inserts and removes,
+     * so no single call has to touch the whole table. */
+    struct entry **newtable;
+    unsigned int newsize = primes[pindex];
+
+    /* Only one table can be migrated at a time */
+    while (NULL != h->oldtable) hashtable_rehash(h, rehash_buckets);
+
+    /* calloc gets large tables as fresh zero pages, without a memset */
+    newtable = (struct entry **)calloc(newsize, sizeof(struct entry*));
+    if (NULL == newtable) return 0;
+    h->oldtable       = h->table;
+    h->oldtablelength = h->tablelength;
+    h->rehashindex    = 0;
+    h->table          = newtable;
+    h->tablelength    = newsize;
+    h->primeindex     = pindex;
+    h->loadlimit      = (unsigned int) ceil(newsize * max_load_factor);
     return -1;
 }
 
+/*****************************************************************************/
+static int
+hashtable_expand(struct hashtable *h)
+{
+    /* Double the size of the table to accomodate more entries */
+    /* Check we're not hitting max capacity */
+    if (h->primeindex == (prime_table_length - 1)) return 0;
+    return hashtable_resize(h, h->primeindex + 1);
+}
+
+/*****************************************************************************/
+static int
+hashtable_shrink(struct hashtable *h)
+{
+    /* Compact the table once the load factor dropped below
+     * min_load_factor, to the smallest size at half the load limit */
+    unsigned int pindex;
+    if (NULL != h->oldtable || h->primeindex == h->minprimeindex) return 0;
+    if (h->entrycount >= h->tablelength * min_load_factor) return 0;
+    for (pindex = h->minprimeindex; pindex < h->primeindex; pindex++) {
+        if (h->entrycount < primes[pindex] * max_load_factor / 2) break;
+    }
+    if (pindex == h->primeindex) return 0;
+    return hashtable_resize(h, pindex);
+}
+
 /*****************************************************************************/
 unsigned int
 hashtable_count(struct hashtable *h)
@@ -139,6 +176,7 @@ hashtable_insert(struct hashtable *h, void *k, void *v)
     /* This method allows duplicate keys - but they shouldn't be used */
     unsigned int index;
     struct entry *e;
+    if (NULL != h->oldtable) hashtable_rehash(h, rehash_buckets);
     if (++(h->entrycount) > h->loadlimit)
     {
         /* Ignore the return value. If expand fails, we should
@@ -173,6 +211,17 @@ hashtable_search(struct hashtable *h, void *k)
         if ((hashvalue == e->h) && (h->eqfn(k, e->k))) return e->v;
         e = e->next;
     }
+    /* Not migrated yet? Searching does not migrate, so it is safe while
+     * iterating. */
+    if (NULL != h->oldtable)
+    {
+        e = h->oldtable[indexFor(h->oldtablelength,hashvalue)];
+        while (NULL != e)
+        {
+            if ((hashvalue == e->h) && (h->eqfn(k, e->k))) return e->v;
+            e = e->next;
+        }
+    }
     return NULL;
 }
 
@@ -180,32 +229,39 @@ hashtable_search(struct hashtable *h, void *k)
 void * /* returns value associated with key */
 hashtable_remove(struct hashtable *h, void *k)
 {
-    /* TODO: consider compacting the table when the load factor drops enough,
-     *       or provide a 'compact' method. */
-
     struct entry *e;
     struct entry **pE;
     void *v;
-    unsigned int hashvalue, index;
+    unsigned int hashvalue, pass;
 
+    if (NULL != h->oldtable) hashtable_rehash(h, rehash_buckets);
     hashvalue = hash(h,k);
-    index = indexFor(h->tablelength,hash(h,k));
-    pE = &(h->table[index]);
-    e = *pE;
-    while (NULL != e)
+    /* First the current table, then the one being migrated */
+    for (pass = 0; pass < 2; pass++)
     {
-        /* Check hash value to short circuit heavier comparison */
-        if ((hashvalue == e->h) && (h->eqfn(k, e->k)))
+        if (0 == pass)
+            pE = &(h->table[indexFor(h->tablelength,hashvalue)]);
+        else if (NULL != h->oldtable)
+            pE = &(h->oldtable[indexFor(h->oldtablelength,hashvalue)]);
+        else
+            break;
+        e = *pE;
+        while (NULL != e)
         {
-            *pE = e->next;
-            h->entrycount--;
-            v = e->v;
-            freekey(e->k);
-            free(e);
-            return v;
+            /* Check hash value to short circuit heavier comparison */
+            if ((hashvalue == e->h) && (h->eqfn(k, e->k)))
+            {
+                *pE = e->next;
+                h->entrycount--;
+                v = e->v;
+                freekey(e->k);
+                free(e);
+                hashtable_shrink(h);
+                return v;
+            }
+            pE = &(e->next);
+            e = e->next;
         }
-        pE = &(e->next);
-        e = e->next;
     }
     return NULL;
 }
@@ -217,25 +273,25 @@ hashtable_destroy(struct hashtable *h, int free_values)
 {
     unsigned int i;
     struct entry *e, *f;
-    struct entry **table = h->table;
     if (free_values)
     {
-        for (i = 0; i < h->tablelength; i++)
+        for (i = 0; i < h->oldtablelength + h->tablelength; i++)
         {
-            e = table[i];
+            e = *bucketAt(h,i);
             while (NULL != e)
             { f = e; e = e->next; freekey(f->k); free(f->v); free(f); }
         }
     }
     else
     {
-        for (i = 0; i < h->tablelength; i++)
+        for (i = 0; i < h->oldtablelength + h->tablelength; i++)
         {
-            e = table[i];
+            e = *bucketAt(h,i);
             while (NULL != e)
             { f = e; e = e->next; freekey(f->k); free(f); }
         }
     }
+    free(h->oldtable);
     free(h->table);
     free(h);
 }
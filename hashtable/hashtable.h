@@ -86,7 +86,9 @@ create_hashtable(unsigned int minsize,
  * @return      non-zero for successful insertion
  *
  * This function will cause the table to expand if the insertion would take
- * the ratio of entries to table size over the maximum load factor.
+ * the ratio of entries to table size over the maximum load factor. The
+ * entries move to the larger table a few buckets per insert and remove, so
+ * an expansion does not stall a single call.
  *
  * This function does not check for repeated insertions with a duplicate key.
  * The value returned when using a duplicate key is undefined -- when
@@ -129,6 +131,11 @@ valuetype * fnname (struct hashtable *h, keytype *k) \
  * @param   h   the hashtable to remove the item from
  * @param   k   the key to search for  - does not claim ownership
  * @return      the value associated with the key, or NULL if none found
+ *
+ * The table is compacted once the ratio of entries to table size drops
+ * below the minimum load factor, but never below its created size.
+ * Like insert, this function moves entries of a resized table, so neither
+ * may be called while iterating - use hashtable_iterator_remove instead.
  */
 
 void * /* returns value */
@@ -18,15 +18,15 @@ hashtable_iterator(struct hashtable *h)
     itr->h = h;
     itr->e = NULL;
     itr->parent = NULL;
-    tablelength = h->tablelength;
+    tablelength = h->oldtablelength + h->tablelength;
     itr->index = tablelength;
     if (0 == h->entrycount) return itr;
 
     for (i = 0; i < tablelength; i++)
     {
-        if (NULL != h->table[i])
+        if (NULL != *bucketAt(h,i))
         {
-            itr->e = h->table[i];
+            itr->e = *bucketAt(h,i);
             itr->index = i;
             break;
         }
@@ -54,7 +54,6 @@ int
 hashtable_iterator_advance(struct hashtable_itr *itr)
 {
     unsigned int j,tablelength;
-    struct entry **table;
     struct entry *next;
     if (NULL == itr->e) return 0; /* stupidity check */
 
@@ -65,15 +64,14 @@ hashtable_iterator_advance(struct hashtable_itr *itr)
         itr->e = next;
         return -1;
     }
-    tablelength = itr->h->tablelength;
+    tablelength = itr->h->oldtablelength + itr->h->tablelength;
     itr->parent = NULL;
     if (tablelength <= (j = ++(itr->index)))
     {
         itr->e = NULL;
         return 0;
     }
-    table = itr->h->table;
-    while (NULL == (next = table[j]))
+    while (NULL == (next = *bucketAt(itr->h,j)))
     {
         if (++j >= tablelength)
         {
@@ -105,7 +103,7 @@ hashtable_iterator_remove(struct hashtable_itr *itr)
     if (NULL == (itr->parent))
     {
         /* element is head of a chain */
-        itr->h->table[itr->index] = itr->e->next;
+        *bucketAt(itr->h,itr->index) = itr->e->next;
     } else {
         /* element is mid-chain */
         itr->parent->next = itr->e->next;
@@ -129,26 +127,35 @@ hashtable_iterator_search(struct hashtable_itr *itr,
                           struct hashtable *h, void *k)
 {
     struct entry *e, *parent;
-    unsigned int hashvalue, index;
+    unsigned int hashvalue, index, pass;
 
     hashvalue = hash(h,k);
-    index = indexFor(h->tablelength,hashvalue);
-
-    e = h->table[index];
-    parent = NULL;
-    while (NULL != e)
+    /* First the current table, then the one being migrated */
+    for (pass = 0; pass < 2; pass++)
     {
-        /* Check hash value to short circuit heavier comparison */
-        if ((hashvalue == e->h) && (h->eqfn(k, e->k)))
+        if (0 == pass)
+            index = indexFor(h->tablelength,hashvalue);
+        else if (NULL != h->oldtable)
+            index = h->tablelength + indexFor(h->oldtablelength,hashvalue);
+        else
+            break;
+
+        e = *bucketAt(h,index);
+        parent = NULL;
+        while (NULL != e)
         {
-            itr->index = index;
-            itr->e = e;
-            itr->parent = parent;
-            itr->h = h;
-            return -1;
+            /* Check hash value to short circuit heavier comparison */
+            if ((hashvalue == e->h) && (h->eqfn(k, e->k)))
+            {
+                itr->index = index;
+                itr->e = e;
+                itr->parent = parent;
+                itr->h = h;
+                return -1;
+            }
+            parent = e;
+            e = e->next;
         }
-        parent = e;
-        e = e->next;
     }
     return 0;
 }
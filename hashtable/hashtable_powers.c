@@ -27,6 +27,9 @@ create_hashtable(unsigned int minsize,
     if (NULL == h->table) { free(h); return NULL; } /*oom*/
     for (i=0;i<size;i++) { h->table[i] = NULL; }
     h->tablelength  = size;
+    h->oldtable     = NULL; /* resized in one go, never migrating */
+    h->oldtablelength = 0;
+    h->rehashindex  = 0;
     h->entrycount   = 0;
     h->hashfn       = hashf;
     h->eqfn         = eqf;
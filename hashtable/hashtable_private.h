@@ -19,6 +19,10 @@ struct hashtable {
     unsigned int entrycount;
     unsigned int loadlimit;
     unsigned int primeindex;
+    unsigned int minprimeindex;     /* never shrink below the created size */
+    struct entry **oldtable;        /* table being migrated, NULL if none */
+    unsigned int oldtablelength;
+    unsigned int rehashindex;       /* next bucket of oldtable to migrate */
     unsigned int (*hashfn) (void *k);
     int (*eqfn) (void *k1, void *k2);
 };
@@ -42,6 +46,16 @@ indexFor(unsigned int tablelength, unsigned int hashvalue)
 }
 */
 
+/*****************************************************************************/
+/* bucketAt
+ * While a table is migrated, iterators see the buckets of the new table
+ * first, followed by the buckets of the old table. */
+static inline struct entry **
+bucketAt(struct hashtable *h, unsigned int index) {
+    if (index < h->tablelength) return &(h->table[index]);
+    return &(h->oldtable[index - h->tablelength]);
+}
+
 /*****************************************************************************/
 #define freekey(X) free(X)
 /*define freekey(X) ; */
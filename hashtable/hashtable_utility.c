@@ -19,20 +19,28 @@ int
 hashtable_change(struct hashtable *h, void *k, void *v)
 {
     struct entry *e;
-    unsigned int hashvalue, index;
+    unsigned int hashvalue, pass;
     hashvalue = hash(h,k);
-    index = indexFor(h->tablelength,hashvalue);
-    e = h->table[index];
-    while (NULL != e)
+    /* First the current table, then the one being migrated */
+    for (pass = 0; pass < 2; pass++)
     {
-        /* Check hash value to short circuit heavier comparison */
-        if ((hashvalue == e->h) && (h->eqfn(k, e->k)))
+        if (0 == pass)
+            e = h->table[indexFor(h->tablelength,hashvalue)];
+        else if (NULL != h->oldtable)
+            e = h->oldtable[indexFor(h->oldtablelength,hashvalue)];
+        else
+            break;
+        while (NULL != e)
         {
-            free(e->v);
-            e->v = v;
-            return -1;
+            /* Check hash value to short circuit heavier comparison */
+            if ((hashvalue == e->h) && (h->eqfn(k, e->k)))
+            {
+                free(e->v);
+                e->v = v;
+                return -1;
+            }
+            e = e->next;
         }
-        e = e->next;
     }
     return 0;
 }
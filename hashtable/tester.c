@@ -43,6 +43,15 @@ equalkeys(void *k1, void *k2)
     return (0 == memcmp(k1,k2,sizeof(struct key)));
 }
 
+static void
+setkey(struct key *k, int i)
+{
+    k->one_ip = 0xcfccee40 + i;
+    k->two_ip = 0xcf0cee67 - (5 * i);
+    k->one_port = 22 + (7 * i);
+    k->two_port = 5522 - (3 * i);
+}
+
 /*****************************************************************************/
 int
 main(int argc, char **argv)
@@ -51,7 +60,8 @@ main(int argc, char **argv)
     struct value *v, *found;
     struct hashtable *h;
     struct hashtable_itr *itr;
-    int i;
+    unsigned int size;
+    int i, j;
 
     h = create_hashtable(16, hashfromkey, equalkeys);
     if (NULL == h) exit(-1); /*oom*/
@@ -210,7 +220,10 @@ main(int argc, char **argv)
             printf("BUG: key %u not found for search preremoval using iterator\n", i);
             return 1;
         }
-        if (0 == hashtable_iterator_remove(itr)) {
+        /* zero only tells the iterator reached the end of the table */
+        j = hashtable_count(h);
+        hashtable_iterator_remove(itr);
+        if (hashtable_count(h) != j - 1 || NULL != search_some(h,k)) {
             printf("BUG: key not found for removal using iterator\n");
             return 1;
         }
@@ -228,6 +241,60 @@ main(int argc, char **argv)
     printf("After removal, hashtable contains %u items.\n",
             hashtable_count(h));
 
+/*****************************************************************************/
+/* Hashtable growth and compaction, the table is migrated incrementally */
+
+    hashtable_destroy(h, 1);
+    h = create_hashtable(16, hashfromkey, equalkeys);
+    if (NULL == h) exit(-1); /*oom*/
+    for (i = 0; i < ITEM_COUNT; i++)
+    {
+        kk = (struct key *)malloc(sizeof(struct key));
+        setkey(kk, i);
+        v = (struct value *)malloc(sizeof(struct value));
+        v->id = "a value";
+        if (!insert_some(h,kk,v))
+        {
+            printf("out of memory inserting into third hashtable\n");
+            return 1;
+        }
+        /* keys must be found in the old and in the new table */
+        if (0 == i % 97)
+        {
+            for (j = 0; j <= i; j++)
+            {
+                setkey(k, j);
+                if (NULL == search_some(h,k)) {
+                    printf("BUG: key %d not found while migrating\n", j);
+                    return 1;
+                }
+            }
+        }
+    }
+    size = h->tablelength;
+
+    for (i = 0; i < ITEM_COUNT - 10; i++)
+    {
+        setkey(k, i);
+        if (NULL == (found = remove_some(h,k))) {
+            printf("BUG: key %d not found for removal while compacting\n", i);
+            return 1;
+        }
+        free(found);
+    }
+    itr = hashtable_iterator(h);
+    j = 0;
+    do {
+        j++;
+    } while (hashtable_iterator_advance(itr));
+    free(itr);
+    if (j != hashtable_count(h)) {
+        printf("BUG: iterated through %d of %u entries\n", j, hashtable_count(h));
+        return 1;
+    }
+    printf("After compaction, hashtable contains %u items in %u buckets, had %u.\n",
+            hashtable_count(h), h->tablelength, size);
+
 /*****************************************************************************/
 /* Hashtable destroy */
 
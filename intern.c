@@ -0,0 +1,102 @@
+/*
+ * Logname intern table
+ *
+ * Maps every logname to a small integer id when the message is parsed. The
+ * ids are handed out densely from 0, so everything behind the parser keeps
+ * its per logname state in plain arrays indexed by id instead of hashing and
+ * comparing the name again.
+ *
+ * Lognames come from the network, so the number of ids is bounded. Once all
+ * are taken internName() returns INTERN_FULL and the caller has to drop its
+ * per id state and call internReset() before names can be interned again.
+ *
+ * File:   intern.c
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#include "intern.h"
+#include "nametable.h"
+
+internedName *interned = NULL;			// names by id
+static nametable *ids = NULL;			// id + 1 by name
+static unsigned int capacity = 0;		// maximum number of ids
+static unsigned int count = 0;			// ids handed out
+
+/**
+ * Allocate intern table for up to maxnames lognames
+ * @param unsigned int maxnames
+ */
+void internInit(unsigned int maxnames) {
+	capacity = maxnames;
+	count = 0;
+	interned = calloc(capacity, sizeof(internedName));
+	ids = nametableCreate(capacity);
+	if (interned == NULL || ids == NULL) {
+		syslog(LOG_ERR, "Cannot allocate logname table");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/**
+ * Get id of logname, interning it on first sight
+ * @param const char * name not NUL terminated, shorter than NAMELENGTH
+ * @param size_t len
+ * @param unsigned int hash wyHash() of the name, as computed by the parser
+ * @return unsigned int id or INTERN_FULL
+ */
+unsigned int internName(const char *name, size_t len, unsigned int hash) {
+	internedName *n;
+	void *value;
+	
+	value = nametableSearch(ids, name, len, hash);
+	if (value != NULL) {
+		return (unsigned int) ((uintptr_t) value - 1);
+	}
+	if (count == capacity) {
+		return INTERN_FULL;
+	}
+	
+	n = &interned[count];
+	memcpy(n->name, name, len);
+	n->name[len] = '\0';
+	n->len = len;
+	n->hash = hash;
+	n->messages = 0;
+	nametableInsert(ids, n->name, len, hash, (void *) (uintptr_t) (count + 1));
+	
+	return count++;
+}
+
+/**
+ * Number of interned lognames
+ * @return unsigned int
+ */
+unsigned int internCount(void) {
+	return count;
+}
+
+/**
+ * Forget all lognames, ids are handed out from 0 again
+ */
+void internReset(void) {
+	while (count > 0) {
+		count--;
+		nametableRemove(ids, interned[count].name, interned[count].len, interned[count].hash);
+	}
+}
+
+#ifdef	__cplusplus
+}
+#endif
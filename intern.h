@@ -0,0 +1,43 @@
+/* 
+ * Logname intern table header
+ * 
+ * File:   intern.h
+ * Author: Andreas Behringer
+ * 
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifndef INTERN_H
+#define	INTERN_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "config.h"
+
+#define INTERN_FULL ((unsigned int) -1)	// no id left, see internReset()
+
+// Interned logname, ids are the index into the array of names
+typedef struct internedName {
+	char name[NAMELENGTH];				// NUL terminated
+	size_t len;
+	unsigned int hash;
+	unsigned long messages;				// messages logged with this name
+} internedName;
+
+extern internedName *interned;
+
+void internInit(unsigned int maxnames);
+unsigned int internName(const char *name, size_t len, unsigned int hash);
+unsigned int internCount(void);
+void internReset(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* INTERN_H */
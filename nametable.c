@@ -0,0 +1,233 @@
+/*
+ * Logname table
+ *
+ * Flat open addressing hashtable for lognames. Every slot keeps the hash,
+ * the length and the first bytes of its key inline, so a lookup usually
+ * touches one cache line and compares the full key only on a real match.
+ * Collisions are resolved with Robin Hood probing: an entry inserted further
+ * away from its home slot than the resident one takes its place, which keeps
+ * probe sequences short and lets a search stop early. Removing shifts the
+ * following entries back, there are no tombstones.
+ *
+ * Keys are not copied, they must stay valid while in the table.
+ *
+ * File:   nametable.c
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nametable.h"
+
+/**
+ * Distance of slot i from the home slot of its entry
+ * @param nametable * t
+ * @param unsigned int i
+ * @return unsigned int
+ */
+static inline unsigned int nametableDistance(nametable *t, unsigned int i) {
+	return (i - (t->slots[i].hash & (t->size - 1))) & (t->size - 1);
+}
+
+/**
+ * Compare key with the key of a slot, inline prefix first
+ * @param nameSlot * s
+ * @param const char * key
+ * @param size_t len
+ * @param unsigned int hash
+ * @return int 1 if equal
+ */
+static inline int nametableMatch(nameSlot *s, const char *key, size_t len, unsigned int hash) {
+	if (s->hash != hash || s->len != len) {
+		return 0;
+	}
+	if (len <= NAMEPREFIX) {
+		return memcmp(s->prefix, key, len) == 0;
+	}
+
+	return memcmp(s->prefix, key, NAMEPREFIX) == 0
+			&& memcmp(s->key + NAMEPREFIX, key + NAMEPREFIX, len - NAMEPREFIX) == 0;
+}
+
+/**
+ * Put entry into table without checking for duplicates or load
+ * @param nametable * t
+ * @param nameSlot * entry
+ */
+static void nametablePlace(nametable *t, nameSlot *entry) {
+	nameSlot swap;
+	unsigned int i, resident, dist = 0;
+
+	i = entry->hash & (t->size - 1);
+	while (t->slots[i].key != NULL) {
+		// rich resident closer to its home gives the slot to the poorer entry
+		resident = nametableDistance(t, i);
+		if (resident < dist) {
+			swap = t->slots[i];
+			t->slots[i] = *entry;
+			*entry = swap;
+			dist = resident;
+		}
+		i = (i + 1) & (t->size - 1);
+		dist++;
+	}
+	t->slots[i] = *entry;
+}
+
+/**
+ * Double the number of slots and reinsert all entries
+ * @param nametable * t
+ * @return int 0 on success, -1 if out of memory
+ */
+static int nametableGrow(nametable *t) {
+	nameSlot *old = t->slots;
+	unsigned int i, oldsize = t->size;
+
+	t->slots = calloc(oldsize * 2, sizeof(nameSlot));
+	if (t->slots == NULL) {
+		t->slots = old;
+		return -1;
+	}
+	t->size = oldsize * 2;
+	for (i = 0; i < oldsize; i++) {
+		if (old[i].key != NULL) {
+			nametablePlace(t, &old[i]);
+		}
+	}
+	free(old);
+
+	return 0;
+}
+
+/**
+ * Create table with room for minsize entries without growing
+ * @param unsigned int minsize
+ * @return nametable *
+ */
+nametable * nametableCreate(unsigned int minsize) {
+	nametable *t;
+	unsigned int size = 8;
+
+	// keep load below 3/4
+	while (size * 3 / 4 < minsize) {
+		size <<= 1;
+	}
+	t = malloc(sizeof(nametable));
+	if (t == NULL) {
+		return NULL;
+	}
+	t->slots = calloc(size, sizeof(nameSlot));
+	if (t->slots == NULL) {
+		free(t);
+		return NULL;
+	}
+	t->size = size;
+	t->count = 0;
+
+	return t;
+}
+
+/**
+ * Search value by key
+ * @param nametable * t
+ * @param const char * key
+ * @param size_t len
+ * @param unsigned int hash
+ * @return void * value or NULL
+ */
+void * nametableSearch(nametable *t, const char *key, size_t len, unsigned int hash) {
+	unsigned int i, dist = 0;
+
+	i = hash & (t->size - 1);
+	// an entry closer to its home than we are to ours means the key is absent
+	while (t->slots[i].key != NULL && nametableDistance(t, i) >= dist) {
+		if (nametableMatch(&t->slots[i], key, len, hash)) {
+			return t->slots[i].value;
+		}
+		i = (i + 1) & (t->size - 1);
+		dist++;
+	}
+
+	return NULL;
+}
+
+/**
+ * Insert key, which must not be in the table yet
+ * @param nametable * t
+ * @param const char * key
+ * @param size_t len
+ * @param unsigned int hash
+ * @param void * value
+ * @return int 0 on success, -1 if out of memory
+ */
+int nametableInsert(nametable *t, const char *key, size_t len, unsigned int hash, void *value) {
+	nameSlot entry;
+
+	if ((t->count + 1) > t->size * 3 / 4 && nametableGrow(t) < 0) {
+		return -1;
+	}
+	entry.hash = hash;
+	entry.len = len;
+	memset(entry.prefix, 0, NAMEPREFIX);
+	memcpy(entry.prefix, key, len < NAMEPREFIX ? len : NAMEPREFIX);
+	entry.key = key;
+	entry.value = value;
+	nametablePlace(t, &entry);
+	t->count++;
+
+	return 0;
+}
+
+/**
+ * Remove key and shift following entries back
+ * @param nametable * t
+ * @param const char * key
+ * @param size_t len
+ * @param unsigned int hash
+ * @return void * value of removed key or NULL
+ */
+void * nametableRemove(nametable *t, const char *key, size_t len, unsigned int hash) {
+	unsigned int i, next, dist = 0;
+	void *value;
+
+	i = hash & (t->size - 1);
+	while (t->slots[i].key != NULL && nametableDistance(t, i) >= dist) {
+		if (nametableMatch(&t->slots[i], key, len, hash)) {
+			value = t->slots[i].value;
+			next = (i + 1) & (t->size - 1);
+			while (t->slots[next].key != NULL && nametableDistance(t, next) > 0) {
+				t->slots[i] = t->slots[next];
+				i = next;
+				next = (next + 1) & (t->size - 1);
+			}
+			t->slots[i].key = NULL;
+			t->count--;
+			return value;
+		}
+		i = (i + 1) & (t->size - 1);
+		dist++;
+	}
+
+	return NULL;
+}
+
+/**
+ * Free table, keys and values are owned by the caller
+ * @param nametable * t
+ */
+void nametableDestroy(nametable *t) {
+	free(t->slots);
+	free(t);
+}
+
+#ifdef	__cplusplus
+}
+#endif
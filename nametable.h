@@ -0,0 +1,48 @@
+/* 
+ * Logname table header
+ * 
+ * File:   nametable.h
+ * Author: Andreas Behringer
+ * 
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifndef NAMETABLE_H
+#define	NAMETABLE_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#define NAMEPREFIX 11					// key bytes stored inline in the slot
+
+// Slot of the table, 32 bytes, two per cache line
+typedef struct nameSlot {
+	unsigned int hash;
+	unsigned char len;					// key length, keys are shorter than 256
+	char prefix[NAMEPREFIX];			// first bytes of key, compared before key
+	const char * key;					// full key, NULL if slot is empty
+	void * value;
+} nameSlot;
+
+// Open addressing table with Robin Hood probing, size is a power of two
+typedef struct nametable {
+	nameSlot * slots;
+	unsigned int size;
+	unsigned int count;
+} nametable;
+
+nametable * nametableCreate(unsigned int minsize);
+void * nametableSearch(nametable *t, const char *key, size_t len, unsigned int hash);
+int nametableInsert(nametable *t, const char *key, size_t len, unsigned int hash, void *value);
+void * nametableRemove(nametable *t, const char *key, size_t len, unsigned int hash);
+void nametableDestroy(nametable *t);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* NAMETABLE_H */
@@ -0,0 +1,235 @@
+/*
+ * AF_PACKET TPACKET_V3 ingest engine
+ *
+ * The UDP traffic to the configured port is read from a memory mapped
+ * TPACKET_V3 ring of a packet socket. The kernel fills whole blocks of frames
+ * and hands them over at once, the payloads are logged straight from the ring
+ * without copying them. The UDP socket stays bound so senders get no ICMP
+ * errors, but drops everything before it is queued.
+ *
+ * File:   packet.c
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <syslog.h>
+
+#include "config.h"
+#include "packet.h"
+
+#ifndef PACKET_IGNORE_OUTGOING
+#define PACKET_IGNORE_OUTGOING 23
+#endif
+
+// provided by yaul.c
+extern unsigned int stat_batches;
+extern unsigned int stat_batch_messages;
+void handleDatagram(const char *buffer, size_t len, struct sockaddr_in *cliAddr);
+void checkFlush(void);
+
+static int packet_sock = -1;				// the packet socket
+static char *packet_ring = NULL;			// memory mapped receive ring
+
+/**
+ * Attach filter passing only whole UDP datagrams to our port and address.
+ * Offsets are relative to the IP header.
+ * @param int s
+ * @return int
+ */
+static int packetFilter(int s) {
+	struct in_addr addr;
+	struct sock_fprog prog;
+	unsigned int any;
+	struct sock_filter code[] = {
+		BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 8),
+		BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 6),
+		BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x3fff, 6, 0),
+		BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+		BPF_STMT(BPF_LD | BPF_H | BPF_IND, 2),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, config.port, 0, 3),
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 16),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 1),
+		BPF_STMT(BPF_RET | BPF_K, 0xffff),
+		BPF_STMT(BPF_RET | BPF_K, 0),
+	};
+
+	inet_pton(AF_INET, config.address, &addr);
+	any = (addr.s_addr == htonl(INADDR_ANY));
+	if (any) {
+		// skip the destination address check
+		code[7] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0xffff);
+	} else {
+		code[8].k = ntohl(addr.s_addr);
+	}
+
+	prog.len = sizeof(code) / sizeof(code[0]);
+	prog.filter = code;
+	return setsockopt(s, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+}
+
+/**
+ * Open packet socket with receive ring, fall back to the socket engine if
+ * this fails
+ * @param int s the bound UDP socket
+ * @return int 0 on success, -1 if not available
+ */
+int packetInit(int s) {
+	struct tpacket_req3 req;
+	struct sockaddr_ll ll;
+	struct sock_filter drop[] = { BPF_STMT(BPF_RET | BPF_K, 0) };
+	struct sock_fprog dropall = { 1, drop };
+	int version = TPACKET_V3;
+	int one = 1;
+	int fanout;
+
+	packet_sock = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_IP));
+	if (packet_sock < 0) {
+		return -1;
+	}
+	if (packetFilter(packet_sock) < 0
+			|| setsockopt(packet_sock, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+		goto fail;
+	}
+	// loopback shows every datagram twice otherwise
+	setsockopt(packet_sock, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = PACKET_BLOCKSIZE;
+	req.tp_block_nr = PACKET_BLOCKS;
+	req.tp_frame_size = PACKET_FRAMESIZE;
+	req.tp_frame_nr = (PACKET_BLOCKSIZE / PACKET_FRAMESIZE) * PACKET_BLOCKS;
+	req.tp_retire_blk_tov = PACKET_BLOCKTIMEOUT;
+	if (setsockopt(packet_sock, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+		goto fail;
+	}
+	packet_ring = mmap(NULL, PACKET_BLOCKSIZE * PACKET_BLOCKS, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_LOCKED, packet_sock, 0);
+	if (packet_ring == MAP_FAILED) {
+		packet_ring = mmap(NULL, PACKET_BLOCKSIZE * PACKET_BLOCKS, PROT_READ | PROT_WRITE,
+				MAP_SHARED, packet_sock, 0);
+	}
+	if (packet_ring == MAP_FAILED) {
+		goto fail;
+	}
+
+	memset(&ll, 0, sizeof(ll));
+	ll.sll_family = AF_PACKET;
+	ll.sll_protocol = htons(ETH_P_IP);
+	ll.sll_ifindex = config.interface ? if_nametoindex(config.interface) : 0;
+	if (config.interface && ll.sll_ifindex == 0) {
+		syslog(LOG_ERR, "Unknown interface %s", config.interface);
+		goto fail;
+	}
+	if (bind(packet_sock, (struct sockaddr *) &ll, sizeof(ll)) < 0) {
+		goto fail;
+	}
+
+	// workers share the traffic, fragmented datagrams are reassembled first
+	fanout = ((config.opt_workers > 1 ? getppid() : getpid()) & 0xffff)
+			| ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+	if (setsockopt(packet_sock, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) < 0) {
+		goto fail;
+	}
+
+	setsockopt(s, SOL_SOCKET, SO_ATTACH_FILTER, &dropall, sizeof(dropall));
+
+	return 0;
+
+fail:
+	close(packet_sock);
+	packet_sock = -1;
+	return -1;
+}
+
+/**
+ * Log all datagrams of a block handed over by the kernel
+ * @param struct tpacket_block_desc * block
+ */
+static void packetBlock(struct tpacket_block_desc *block) {
+	struct tpacket3_hdr *frame;
+	struct sockaddr_in cliAddr;
+	unsigned char *ip, *udp;
+	char *payload;
+	unsigned int i, ihl, len, avail;
+
+	frame = (struct tpacket3_hdr *) ((char *) block + block->hdr.bh1.offset_to_first_pkt);
+	for (i = 0; i < block->hdr.bh1.num_pkts; i++) {
+		ip = (unsigned char *) frame + frame->tp_net;
+		avail = frame->tp_snaplen - (frame->tp_net - frame->tp_mac);
+		ihl = (ip[0] & 0x0f) * 4;
+		if (avail >= ihl + 8) {
+			udp = ip + ihl;
+			len = ((udp[4] << 8) | udp[5]) - 8;
+			if (len > avail - ihl - 8) {
+				len = avail - ihl - 8;
+			}
+			if (len > BUF) {
+				len = BUF;
+			}
+
+			memset(&cliAddr, 0, sizeof(cliAddr));
+			cliAddr.sin_family = AF_INET;
+			memcpy(&cliAddr.sin_addr, ip + 12, 4);
+			memcpy(&cliAddr.sin_port, udp, 2);
+
+			payload = (char *) udp + 8;
+			handleDatagram(payload, len, &cliAddr);
+		}
+		frame = (struct tpacket3_hdr *) ((char *) frame + frame->tp_next_offset);
+	}
+
+	stat_batches++;
+	stat_batch_messages += block->hdr.bh1.num_pkts;
+}
+
+/**
+ * The packet ring receiver loop, running forever, stopped by signals
+ */
+void packetLoop(void) {
+	struct tpacket_block_desc *block;
+	struct pollfd pfd;
+	unsigned int current = 0;
+
+	pfd.fd = packet_sock;
+	pfd.events = POLLIN | POLLERR;
+	pfd.revents = 0;
+
+	while (1) {
+		checkFlush();
+		block = (struct tpacket_block_desc *) (packet_ring + current * PACKET_BLOCKSIZE);
+		if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+			poll(&pfd, 1, -1);
+			continue;
+		}
+
+		packetBlock(block);
+
+		__atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+		current = (current + 1) % PACKET_BLOCKS;
+	}
+}
+
+#ifdef	__cplusplus
+}
+#endif
@@ -0,0 +1,30 @@
+/*
+ * AF_PACKET TPACKET_V3 ingest engine header
+ *
+ * File:   packet.h
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifndef PACKET_H
+#define	PACKET_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define PACKET_BLOCKSIZE (1 << 20)
+#define PACKET_BLOCKS 64
+#define PACKET_FRAMESIZE 2048
+#define PACKET_BLOCKTIMEOUT 10				// ms until a partly filled block is handed over
+
+int packetInit(int s);
+void packetLoop(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* PACKET_H */
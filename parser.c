@@ -0,0 +1,128 @@
+/*
+ * Message parser
+ *
+ * Splits a message of the form [<logname>]<message> into slices. The logname
+ * charset is checked 16 bytes at a time with SSE2 where available and with a
+ * lookup table for the rest, the newline is searched with memchr, which the
+ * C library already vectorizes. The logname is hashed here once, the tables
+ * further down reuse that hash.
+ *
+ * File:   parser.c
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "config.h"
+#include "parser.h"
+#include "hash.h"
+
+#define LOGNAME_DEFAULT "yaul"
+
+// Characters allowed in lognames: a-z, A-Z, 0-9 and the dot
+static const unsigned char lognameChars[256] = {
+	['.'] = 1,
+	['0'] = 1, ['1'] = 1, ['2'] = 1, ['3'] = 1, ['4'] = 1,
+	['5'] = 1, ['6'] = 1, ['7'] = 1, ['8'] = 1, ['9'] = 1,
+	['A'] = 1, ['B'] = 1, ['C'] = 1, ['D'] = 1, ['E'] = 1, ['F'] = 1, ['G'] = 1,
+	['H'] = 1, ['I'] = 1, ['J'] = 1, ['K'] = 1, ['L'] = 1, ['M'] = 1, ['N'] = 1,
+	['O'] = 1, ['P'] = 1, ['Q'] = 1, ['R'] = 1, ['S'] = 1, ['T'] = 1, ['U'] = 1,
+	['V'] = 1, ['W'] = 1, ['X'] = 1, ['Y'] = 1, ['Z'] = 1,
+	['a'] = 1, ['b'] = 1, ['c'] = 1, ['d'] = 1, ['e'] = 1, ['f'] = 1, ['g'] = 1,
+	['h'] = 1, ['i'] = 1, ['j'] = 1, ['k'] = 1, ['l'] = 1, ['m'] = 1, ['n'] = 1,
+	['o'] = 1, ['p'] = 1, ['q'] = 1, ['r'] = 1, ['s'] = 1, ['t'] = 1, ['u'] = 1,
+	['v'] = 1, ['w'] = 1, ['x'] = 1, ['y'] = 1, ['z'] = 1,
+};
+
+/**
+ * Find first byte not allowed in lognames
+ *
+ * @param const char * p
+ * @param size_t len
+ * @return size_t offset of the byte or len if all are allowed
+ */
+static inline size_t lognameSpan(const char *p, size_t len) {
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i lower = _mm_set1_epi8(0x20);
+	const __m128i a = _mm_set1_epi8('a' - 1), z = _mm_set1_epi8('z' + 1);
+	const __m128i d0 = _mm_set1_epi8('0' - 1), d9 = _mm_set1_epi8('9' + 1);
+	const __m128i dot = _mm_set1_epi8('.');
+	__m128i c, l, valid;
+	unsigned int invalid;
+
+	// bytes >= 0x80 are negative and fail all signed range checks
+	for (; i + 16 <= len; i += 16) {
+		c = _mm_loadu_si128((const __m128i *) (p + i));
+		l = _mm_or_si128(c, lower);
+		valid = _mm_and_si128(_mm_cmpgt_epi8(l, a), _mm_cmpgt_epi8(z, l));
+		valid = _mm_or_si128(valid, _mm_and_si128(_mm_cmpgt_epi8(c, d0), _mm_cmpgt_epi8(d9, c)));
+		valid = _mm_or_si128(valid, _mm_cmpeq_epi8(c, dot));
+		invalid = ~_mm_movemask_epi8(valid) & 0xffff;
+		if (invalid) {
+			return i + __builtin_ctz(invalid);
+		}
+	}
+#endif
+	while (i < len && lognameChars[(unsigned char) p[i]]) {
+		i++;
+	}
+
+	return i;
+}
+
+/**
+ * Split message into logname and body
+ *
+ * A valid message starts with [<logname>] followed by a non empty first line.
+ * Otherwise the logname is yaul and the whole message is the body. The body
+ * ends at the first newline. The logname comes with its hash.
+ *
+ * @param const char * buffer
+ * @param size_t len
+ * @param parsedMessage * msg
+ * @return int 1 if the message had a valid logname
+ */
+int parseMessage(const char *buffer, size_t len, parsedMessage *msg) {
+	const char *newline;
+	size_t n;
+	int valid = 0;
+
+	if (len > 2 && buffer[0] == '[') {
+		n = lognameSpan(buffer + 1, (len - 1 < NAMELENGTH - 1) ? len - 1 : NAMELENGTH - 1);
+		if (n > 0 && n + 2 < len && buffer[n + 1] == ']' && buffer[n + 2] != '\n') {
+			msg->name = buffer + 1;
+			msg->namelen = n;
+			buffer += n + 2;
+			len -= n + 2;
+			valid = 1;
+		}
+	}
+	if (!valid) {
+		msg->name = LOGNAME_DEFAULT;
+		msg->namelen = sizeof(LOGNAME_DEFAULT) - 1;
+	}
+
+	msg->hash = wyHash(msg->name, msg->namelen);
+	
+	newline = memchr(buffer, '\n', len);
+	msg->body = buffer;
+	msg->bodylen = newline ? (size_t) (newline - buffer) : len;
+
+	return valid;
+}
+
+#ifdef	__cplusplus
+}
+#endif
@@ -0,0 +1,35 @@
+/* 
+ * Message parser header
+ * 
+ * File:   parser.h
+ * Author: Andreas Behringer
+ * 
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifndef PARSER_H
+#define	PARSER_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+// Parsed message, slices of the receive buffer, not NUL terminated
+typedef struct parsedMessage {
+	const char * name;			// logname, or the default logname yaul
+	size_t namelen;
+	unsigned int hash;			// wyHash() of the logname
+	const char * body;			// message up to the first newline
+	size_t bodylen;
+} parsedMessage;
+
+int parseMessage(const char *buffer, size_t len, parsedMessage *msg);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* PARSER_H */
@@ -0,0 +1,520 @@
+/*
+ * Writer pool
+ *
+ * The thread that parses the messages keeps the append buffers and decides
+ * when to flush, the write and close syscalls of the logfiles are handed to
+ * a pool of threads. Every logname has a lane, a short ring of jobs that
+ * runs in order. A lane with jobs is on the ready list of exactly one pool
+ * thread or run by exactly one, so the writes of a logfile never overtake
+ * each other. A lane starts on the list of the thread its id maps to, a
+ * thread without lanes of its own steals a whole lane from the back of the
+ * list of another one.
+ *
+ * Jobs carry a copy of the lines in a buffer of the smallest power of two
+ * size class that fits, finished jobs are kept per class for reuse. The
+ * buffers of all queued jobs together are limited to POOL_MAXBYTES, beyond
+ * that the producer waits for the pool the way it does for a full lane, so a
+ * stalled disk does not make the pool allocate without bounds. The producer
+ * waits on a futex of the count of finished jobs, every finished job wakes it.
+ *
+ * File:   pool.c
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <syslog.h>
+
+#include "config.h"
+#include "queue.h"
+#include "pool.h"
+
+// provided by yaul.c
+extern unsigned int stat_writes;
+extern unsigned long stat_write_bytes;
+extern unsigned int stat_mallocs;
+
+#define POOL_MINJOB 256						// smallest size class of job buffers
+#define POOL_CLASSES 17						// size classes, up to MAXFILEBUFFER
+#define POOL_FREEBYTES 4194304				// buffers of finished jobs kept for reuse
+#define POOL_MAXBYTES 67108864				// buffers of queued jobs before the producer waits
+
+enum {
+	LANE_IDLE,								// no jobs, on no list
+	LANE_READY								// on a ready list or running
+};
+
+// Write or close of a logfile, run by a pool thread
+struct poolJob {
+	struct poolJob *next;
+	int fd;
+	int close;								// close fd after the write
+	unsigned int sizeclass;					// POOL_CLASSES if too large for one
+	size_t size;							// capacity of data
+	size_t len;
+	char data[];
+};
+
+// Jobs of one logname, one producer and one pool thread at a time
+struct poolLane {
+	unsigned int head;						// jobs queued, moved by the producer
+	unsigned int tail;						// jobs done, moved by the thread running the lane
+	int state;
+	unsigned int home;						// pool thread the lane is queued to
+	struct poolJob *jobs[LANE_JOBS];
+} __attribute__((aligned(CACHELINE)));
+
+// Pool thread with its list of ready lanes
+struct poolThread {
+	pthread_mutex_t lock;
+	unsigned int first;						// oldest ready lane
+	unsigned int count;						// ready lanes
+	struct poolLane **ready;				// ring of lanes + 1 entries
+	pthread_t thread;
+	unsigned int index;
+} __attribute__((aligned(CACHELINE)));
+
+static struct poolThread *threads = NULL;	// pool threads
+static unsigned int nthreads = 0;			// number of pool threads
+static struct poolLane *lanes = NULL;		// lanes by logname id
+static unsigned int nlanes = 0;				// number of lanes
+static unsigned int ring_size = 0;			// entries of every ready list
+static int ready = 0;						// lanes on all ready lists
+static int pending = 0;						// jobs not done yet
+static int sleeping = 0;					// pool threads waiting for lanes
+static pthread_mutex_t sleep_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sleep_cond = PTHREAD_COND_INITIALIZER;
+static struct poolJob *jobs_free[POOL_CLASSES];	// finished jobs for reuse by size class
+static size_t jobs_free_bytes = 0;			// buffers of the jobs in jobs_free
+static pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t queued_bytes = 0;				// buffers of jobs not done yet
+static unsigned int jobs_done = 0;			// finished jobs, futex of waiting producers
+static int producers_sleeping = 0;			// producers waiting for a finished job
+static unsigned int stat_steals = 0;		// lanes run by another than their home thread
+static unsigned int stat_runs = 0;			// lanes taken from the ready lists
+
+/**
+ * Sleep until a job finishes, at most QUEUE_WAIT_MS
+ *
+ * The sleeper is counted before jobs_done is checked again, and a pool
+ * thread counts the finished job before checking for sleepers, so one of
+ * both sees the other.
+ * @param unsigned int done jobs_done read before the wait condition
+ */
+static void poolSleep(unsigned int done) {
+	struct timespec timeout = { 0, QUEUE_WAIT_MS * 1000000L };
+
+	__atomic_add_fetch(&producers_sleeping, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&jobs_done, __ATOMIC_SEQ_CST) == done) {
+		syscall(SYS_futex, &jobs_done, FUTEX_WAIT_PRIVATE, done, &timeout, NULL, 0);
+	}
+	__atomic_sub_fetch(&producers_sleeping, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Count finished job and wake up waiting producers, if any
+ */
+static inline void poolWake(void) {
+	__atomic_add_fetch(&jobs_done, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&producers_sleeping, __ATOMIC_SEQ_CST)) {
+		syscall(SYS_futex, &jobs_done, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+	}
+}
+
+/**
+ * Get job for len bytes, reused from its size class if one is kept
+ *
+ * Waits while the queued jobs hold POOL_MAXBYTES, unless none is queued, so
+ * a single job larger than that still gets through.
+ * @param size_t len
+ * @return struct poolJob *
+ */
+static struct poolJob * jobAlloc(size_t len) {
+	struct poolJob *job = NULL;
+	unsigned int sizeclass = 0;
+	size_t size = POOL_MINJOB, queued;
+	unsigned int done;
+
+	while (size < len && sizeclass < POOL_CLASSES) {
+		size <<= 1;
+		sizeclass++;
+	}
+	if (sizeclass == POOL_CLASSES) {
+		size = len;
+	}
+
+	while (1) {
+		done = __atomic_load_n(&jobs_done, __ATOMIC_SEQ_CST);
+		queued = __atomic_load_n(&queued_bytes, __ATOMIC_ACQUIRE);
+		if (queued == 0 || queued + size <= POOL_MAXBYTES) {
+			break;
+		}
+		poolSleep(done);
+	}
+	__atomic_add_fetch(&queued_bytes, size, __ATOMIC_RELAXED);
+
+	if (sizeclass < POOL_CLASSES) {
+		pthread_mutex_lock(&jobs_lock);
+		job = jobs_free[sizeclass];
+		if (job != NULL) {
+			jobs_free[sizeclass] = job->next;
+			jobs_free_bytes -= size;
+		}
+		pthread_mutex_unlock(&jobs_lock);
+		if (job != NULL) {
+			return job;
+		}
+	}
+	job = malloc(sizeof(struct poolJob) + size);
+	stat_mallocs++;
+	if (job == NULL) {
+		perror("Cannot allocate write job");
+		exit(EXIT_FAILURE);
+	}
+	job->sizeclass = sizeclass;
+	job->size = size;
+
+	return job;
+}
+
+/**
+ * Keep finished job for reuse, or free it if it is oversized or enough are kept
+ * @param struct poolJob * job
+ */
+static void jobFree(struct poolJob *job) {
+	__atomic_sub_fetch(&queued_bytes, job->size, __ATOMIC_RELEASE);
+	if (job->sizeclass < POOL_CLASSES) {
+		pthread_mutex_lock(&jobs_lock);
+		if (jobs_free_bytes + job->size <= POOL_FREEBYTES) {
+			job->next = jobs_free[job->sizeclass];
+			jobs_free[job->sizeclass] = job;
+			jobs_free_bytes += job->size;
+			job = NULL;
+		}
+		pthread_mutex_unlock(&jobs_lock);
+	}
+	free(job);
+}
+
+/**
+ * Put lane at the end of the ready list of its home thread
+ * @param struct poolLane * lane
+ */
+static void laneSchedule(struct poolLane *lane) {
+	struct poolThread *t = &threads[lane->home];
+
+	pthread_mutex_lock(&t->lock);
+	t->ready[(t->first + t->count) % ring_size] = lane;
+	// read without the lock by threads looking for a lane to steal
+	__atomic_store_n(&t->count, t->count + 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&t->lock);
+
+	__atomic_add_fetch(&ready, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&sleeping, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&sleep_lock);
+		pthread_cond_signal(&sleep_cond);
+		pthread_mutex_unlock(&sleep_lock);
+	}
+}
+
+/**
+ * Take a lane from the ready lists, the own one first
+ * @param struct poolThread * self
+ * @return struct poolLane * or NULL if all lists are empty
+ */
+static struct poolLane * laneTake(struct poolThread *self) {
+	struct poolThread *t;
+	struct poolLane *lane = NULL;
+	unsigned int i;
+
+	if (__atomic_load_n(&ready, __ATOMIC_SEQ_CST) == 0) {
+		return NULL;
+	}
+	pthread_mutex_lock(&self->lock);
+	if (self->count > 0) {
+		lane = self->ready[self->first];
+		self->first = (self->first + 1) % ring_size;
+		__atomic_store_n(&self->count, self->count - 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&self->lock);
+
+	// steal from the other end, away from the owner
+	for (i = 1; lane == NULL && i < nthreads; i++) {
+		t = &threads[(self->index + i) % nthreads];
+		if (__atomic_load_n(&t->count, __ATOMIC_RELAXED) == 0) {
+			continue;
+		}
+		pthread_mutex_lock(&t->lock);
+		if (t->count > 0) {
+			__atomic_store_n(&t->count, t->count - 1, __ATOMIC_RELAXED);
+			lane = t->ready[(t->first + t->count) % ring_size];
+		}
+		pthread_mutex_unlock(&t->lock);
+		if (lane != NULL) {
+			__atomic_add_fetch(&stat_steals, 1, __ATOMIC_RELAXED);
+		}
+	}
+	if (lane != NULL) {
+		__atomic_sub_fetch(&ready, 1, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&stat_runs, 1, __ATOMIC_RELAXED);
+	}
+
+	return lane;
+}
+
+/**
+ * Write the data of a job, continues after short writes
+ * @param struct poolJob * job
+ * @return ssize_t bytes written or -1 on error
+ */
+static ssize_t jobWrite(struct poolJob *job) {
+	size_t done = 0;
+	ssize_t len;
+
+	while (done < job->len) {
+		len = write(job->fd, job->data + done, job->len - done);
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		done += len;
+	}
+
+	return done;
+}
+
+/**
+ * Run the jobs of a lane until it is empty
+ *
+ * The lane is marked idle before it is checked a last time, and the producer
+ * queues a job before it checks the mark, so either this thread sees the job
+ * or the producer puts the lane on a ready list again.
+ * @param struct poolLane * lane
+ */
+static void laneRun(struct poolLane *lane) {
+	struct poolJob *job;
+	unsigned int tail = lane->tail;
+	int state;
+	ssize_t len;
+
+	while (1) {
+		while (tail != __atomic_load_n(&lane->head, __ATOMIC_ACQUIRE)) {
+			job = lane->jobs[tail % LANE_JOBS];
+			if (job->len > 0) {
+				len = jobWrite(job);
+				if (len < 0) {
+					syslog(LOG_ERR, "Cannot write logfile: %s", strerror(errno));
+				} else {
+					__atomic_add_fetch(&stat_writes, 1, __ATOMIC_RELAXED);
+					__atomic_add_fetch(&stat_write_bytes, len, __ATOMIC_RELAXED);
+				}
+			}
+			if (job->close) {
+				close(job->fd);
+			}
+			jobFree(job);
+			tail++;
+			__atomic_store_n(&lane->tail, tail, __ATOMIC_RELEASE);
+			__atomic_sub_fetch(&pending, 1, __ATOMIC_RELEASE);
+			poolWake();
+		}
+		__atomic_store_n(&lane->state, LANE_IDLE, __ATOMIC_SEQ_CST);
+		if (tail == __atomic_load_n(&lane->head, __ATOMIC_SEQ_CST)) {
+			return;
+		}
+		state = LANE_IDLE;
+		if (!__atomic_compare_exchange_n(&lane->state, &state, LANE_READY, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+			// the producer was faster and queued the lane again
+			return;
+		}
+	}
+}
+
+/**
+ * Pool thread: run ready lanes, sleep while there are none
+ * @param void * arg struct poolThread of this thread
+ * @return void *
+ */
+static void * poolThreadMain(void *arg) {
+	struct poolThread *self = arg;
+	struct poolLane *lane;
+	struct timespec timeout;
+
+	while (1) {
+		lane = laneTake(self);
+		if (lane != NULL) {
+			laneRun(lane);
+			continue;
+		}
+		pthread_mutex_lock(&sleep_lock);
+		__atomic_add_fetch(&sleeping, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&ready, __ATOMIC_SEQ_CST) == 0) {
+			clock_gettime(CLOCK_REALTIME, &timeout);
+			timeout.tv_nsec += QUEUE_WAIT_MS * 1000000L;
+			if (timeout.tv_nsec >= 1000000000L) {
+				timeout.tv_sec++;
+				timeout.tv_nsec -= 1000000000L;
+			}
+			pthread_cond_timedwait(&sleep_cond, &sleep_lock, &timeout);
+		}
+		__atomic_sub_fetch(&sleeping, 1, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&sleep_lock);
+	}
+
+	return NULL;
+}
+
+/**
+ * Queue job to the lane of a logname, waits while the lane is full
+ * @param unsigned int id Logname id
+ * @param struct poolJob * job
+ */
+static void poolQueue(unsigned int id, struct poolJob *job) {
+	struct poolLane *lane = &lanes[id % nlanes];
+	unsigned int head = lane->head, done;
+	int state = LANE_IDLE;
+
+	while (1) {
+		done = __atomic_load_n(&jobs_done, __ATOMIC_SEQ_CST);
+		if (head - __atomic_load_n(&lane->tail, __ATOMIC_ACQUIRE) < LANE_JOBS) {
+			break;
+		}
+		poolSleep(done);
+	}
+	lane->jobs[head % LANE_JOBS] = job;
+	__atomic_add_fetch(&pending, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&lane->head, head + 1, __ATOMIC_SEQ_CST);
+	if (__atomic_compare_exchange_n(&lane->state, &state, LANE_READY, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+		laneSchedule(lane);
+	}
+}
+
+/**
+ * Start pool threads, they run with all signals blocked
+ * @param unsigned int writers number of pool threads
+ * @param unsigned int count number of lanes, one per logname id
+ */
+void poolStart(unsigned int writers, unsigned int count) {
+	sigset_t all, old;
+	unsigned int i;
+
+	nthreads = writers;
+	nlanes = count;
+	ring_size = count + 1;
+	threads = calloc(nthreads, sizeof(struct poolThread));
+	if (threads == NULL || posix_memalign((void **) &lanes, CACHELINE, nlanes * sizeof(struct poolLane)) != 0) {
+		perror("Cannot allocate writer pool");
+		exit(EXIT_FAILURE);
+	}
+	memset(lanes, 0, nlanes * sizeof(struct poolLane));
+	for (i = 0; i < nlanes; i++) {
+		lanes[i].home = i % nthreads;
+	}
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	for (i = 0; i < nthreads; i++) {
+		threads[i].index = i;
+		threads[i].ready = calloc(ring_size, sizeof(struct poolLane *));
+		pthread_mutex_init(&threads[i].lock, NULL);
+		if (threads[i].ready == NULL || pthread_create(&threads[i].thread, NULL, poolThreadMain, &threads[i]) != 0) {
+			perror("Cannot start writer pool");
+			exit(EXIT_FAILURE);
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+/**
+ * Queue write of lines to a logfile
+ * @param unsigned int lane Logname id
+ * @param int fd
+ * @param const struct iovec * iov
+ * @param int iovcnt
+ */
+void poolWrite(unsigned int lane, int fd, const struct iovec *iov, int iovcnt) {
+	struct poolJob *job;
+	size_t len = 0;
+	int i;
+
+	for (i = 0; i < iovcnt; i++) {
+		len += iov[i].iov_len;
+	}
+	job = jobAlloc(len);
+	job->fd = fd;
+	job->close = 0;
+	job->len = 0;
+	for (i = 0; i < iovcnt; i++) {
+		memcpy(job->data + job->len, iov[i].iov_base, iov[i].iov_len);
+		job->len += iov[i].iov_len;
+	}
+	poolQueue(lane, job);
+}
+
+/**
+ * Queue close of a logfile, after its queued writes
+ * @param unsigned int lane Logname id
+ * @param int fd
+ */
+void poolClose(unsigned int lane, int fd) {
+	struct poolJob *job;
+
+	job = jobAlloc(0);
+	job->fd = fd;
+	job->close = 1;
+	job->len = 0;
+	poolQueue(lane, job);
+}
+
+/**
+ * Wait until all queued jobs are done
+ */
+void poolDrain(void) {
+	unsigned int done;
+
+	while (1) {
+		done = __atomic_load_n(&jobs_done, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&pending, __ATOMIC_ACQUIRE) == 0) {
+			break;
+		}
+		poolSleep(done);
+	}
+}
+
+/**
+ * Number of lanes run by another than their home thread
+ * @return unsigned int
+ */
+unsigned int poolSteals(void) {
+	return __atomic_load_n(&stat_steals, __ATOMIC_RELAXED);
+}
+
+/**
+ * Number of lanes taken from the ready lists
+ * @return unsigned int
+ */
+unsigned int poolRuns(void) {
+	return __atomic_load_n(&stat_runs, __ATOMIC_RELAXED);
+}
+
+#ifdef	__cplusplus
+}
+#endif
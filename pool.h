@@ -0,0 +1,33 @@
+/* 
+ * Writer pool header
+ * 
+ * File:   pool.h
+ * Author: Andreas Behringer
+ * 
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifndef POOL_H
+#define	POOL_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <sys/uio.h>
+
+#define LANE_JOBS 64					// queued jobs per logname before the producer waits
+
+void poolStart(unsigned int writers, unsigned int lanes);
+void poolWrite(unsigned int lane, int fd, const struct iovec *iov, int iovcnt);
+void poolClose(unsigned int lane, int fd);
+void poolDrain(void);
+unsigned int poolSteals(void);
+unsigned int poolRuns(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* POOL_H */
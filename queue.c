@@ -0,0 +1,345 @@
+/*
+ * Message queues between threads
+ *
+ * The receive thread copies every datagram into a slot of a ring and the
+ * writer thread takes it from there, so a stalled disk only fills the ring
+ * instead of the socket buffer. Producer and consumer each own a counter on
+ * their own cache line and keep a cached copy of the other one, so they only
+ * touch the line of the other side when the ring looks full or empty.
+ *
+ * With several receive threads they share a ring of the Vyukov kind: a
+ * producer claims a batch of slots by moving the head with compare and swap
+ * and marks every slot filled by its sequence number, so the consumer takes
+ * slots strictly in the order they were claimed, whichever producer is
+ * still filling a later one.
+ *
+ * A side that has to wait sleeps on the counter of the other side with a
+ * futex, at most QUEUE_WAIT_MS. The other side only makes the wake up call
+ * when a thread is sleeping.
+ *
+ * File:   queue.c
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "queue.h"
+
+/**
+ * Sleep while a counter keeps its value
+ *
+ * The sleeper is counted before the counter is checked again, and the other
+ * side changes the counter before checking the count, so one of both sees
+ * the other and no wake up gets lost.
+ * @param unsigned int * counter
+ * @param unsigned int value
+ * @param int * sleeping number of sleeping threads
+ */
+static void queueSleep(unsigned int *counter, unsigned int value, int *sleeping) {
+	struct timespec timeout = { 0, QUEUE_WAIT_MS * 1000000L };
+
+	__atomic_add_fetch(sleeping, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(counter, __ATOMIC_SEQ_CST) == value) {
+		syscall(SYS_futex, counter, FUTEX_WAIT_PRIVATE, value, &timeout, NULL, 0);
+	}
+	__atomic_sub_fetch(sleeping, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Wake up all threads sleeping on counter, if any
+ * @param unsigned int * counter
+ * @param int * sleeping
+ */
+static inline void queueWake(unsigned int *counter, int *sleeping) {
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(sleeping, __ATOMIC_RELAXED)) {
+		syscall(SYS_futex, counter, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+	}
+}
+
+/**
+ * Allocate cache line aligned ring header and slots
+ * @param size_t header size of the ring struct
+ * @param unsigned int slots rounded up to a power of two
+ * @param unsigned int * mask set to number of slots - 1
+ * @param queueSlot ** ring slots
+ * @return void * ring or NULL if out of memory
+ */
+static void * queueAlloc(size_t header, unsigned int slots, unsigned int *mask, queueSlot **ring) {
+	void *r;
+	unsigned int size = 2;
+
+	while (size < slots) {
+		size <<= 1;
+	}
+	if (posix_memalign(&r, CACHELINE, header) != 0) {
+		return NULL;
+	}
+	memset(r, 0, header);
+	if (posix_memalign((void **) ring, CACHELINE, size * sizeof(queueSlot)) != 0) {
+		free(r);
+		return NULL;
+	}
+	*mask = size - 1;
+
+	return r;
+}
+
+/**
+ * Allocate ring, the number of slots is rounded up to a power of two
+ * @param unsigned int slots
+ * @return spscRing * or NULL if out of memory
+ */
+spscRing * spscCreate(unsigned int slots) {
+	spscRing *r;
+	unsigned int mask;
+	queueSlot *ring;
+
+	r = queueAlloc(sizeof(spscRing), slots, &mask, &ring);
+	if (r != NULL) {
+		r->mask = mask;
+		r->slots = ring;
+	}
+
+	return r;
+}
+
+/**
+ * Producer: get the next free slot, waits while the ring is full
+ * @param spscRing * r
+ * @return queueSlot * to fill and hand over with spscPublish()
+ */
+queueSlot * spscReserve(spscRing *r) {
+	unsigned int head = r->head;
+
+	if (head - r->tailCache > r->mask) {
+		r->tailCache = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+		if (head - r->tailCache > r->mask) {
+			r->fullWaits++;
+			do {
+				queueSleep(&r->tail, r->tailCache, &r->producerSleeping);
+				r->tailCache = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+			} while (head - r->tailCache > r->mask);
+		}
+	}
+
+	return &r->slots[head & r->mask];
+}
+
+/**
+ * Producer: hand the reserved slot to the consumer
+ * @param spscRing * r
+ */
+void spscPublish(spscRing *r) {
+	__atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+	queueWake(&r->head, &r->consumerSleeping);
+}
+
+/**
+ * Consumer: get the i-th oldest published slot
+ * @param spscRing * r
+ * @param unsigned int i 0 for the oldest
+ * @return queueSlot * or NULL if fewer slots are published
+ */
+queueSlot * spscPeek(spscRing *r, unsigned int i) {
+	unsigned int tail = r->tail;
+
+	if (r->headCache - tail <= i) {
+		r->headCache = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		if (r->headCache - tail <= i) {
+			return NULL;
+		}
+		if (r->headCache - tail > r->highWater) {
+			r->highWater = r->headCache - tail;
+		}
+	}
+
+	return &r->slots[(tail + i) & r->mask];
+}
+
+/**
+ * Consumer: give the n oldest slots back to the producer
+ * @param spscRing * r
+ * @param unsigned int n
+ */
+void spscRelease(spscRing *r, unsigned int n) {
+	__atomic_store_n(&r->tail, r->tail + n, __ATOMIC_RELEASE);
+	queueWake(&r->tail, &r->producerSleeping);
+}
+
+/**
+ * Consumer: sleep until a slot is published, a signal arrives or
+ * QUEUE_WAIT_MS passed
+ * @param spscRing * r
+ */
+void spscWait(spscRing *r) {
+	queueSleep(&r->head, r->tail, &r->consumerSleeping);
+}
+
+/**
+ * Number of slots filled right now, for statistics
+ * @param spscRing * r
+ * @return unsigned int
+ */
+unsigned int spscDepth(spscRing *r) {
+	return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Allocate multi producer ring, the number of slots is rounded up to a power
+ * of two
+ * @param unsigned int slots
+ * @return mpscRing * or NULL if out of memory
+ */
+mpscRing * mpscCreate(unsigned int slots) {
+	mpscRing *r;
+	unsigned int i, mask;
+	queueSlot *ring;
+
+	r = queueAlloc(sizeof(mpscRing), slots, &mask, &ring);
+	if (r != NULL) {
+		r->mask = mask;
+		r->slots = ring;
+		for (i = 0; i <= mask; i++) {
+			ring[i].seq = i;
+		}
+	}
+
+	return r;
+}
+
+/**
+ * Producer: claim n consecutive slots, waits while they are not free
+ *
+ * The consumer frees slots in order, so the last one of the batch being free
+ * means all of them are.
+ * @param mpscRing * r
+ * @param unsigned int n at most the size of the ring
+ * @return unsigned int position of the first slot, see mpscSlot()
+ */
+unsigned int mpscClaim(mpscRing *r, unsigned int n) {
+	unsigned int pos, last, tail;
+	int waited = 0;
+
+	pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	while (1) {
+		tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+		last = pos + n - 1;
+		if ((int) (__atomic_load_n(&r->slots[last & r->mask].seq, __ATOMIC_ACQUIRE) - last) < 0) {
+			// ring full
+			if (!waited) {
+				__atomic_add_fetch(&r->fullWaits, 1, __ATOMIC_RELAXED);
+				waited = 1;
+			}
+			queueSleep(&r->tail, tail, &r->producerSleeping);
+			pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+			continue;
+		}
+		if (__atomic_compare_exchange_n(&r->head, &pos, pos + n, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			return pos;
+		}
+		// another producer was faster, pos holds the new head
+		__atomic_add_fetch(&r->claimRetries, 1, __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * Slot at a position returned by mpscClaim()
+ * @param mpscRing * r
+ * @param unsigned int pos
+ * @return queueSlot *
+ */
+queueSlot * mpscSlot(mpscRing *r, unsigned int pos) {
+	return &r->slots[pos & r->mask];
+}
+
+/**
+ * Producer: hand n filled slots from position pos to the consumer
+ * @param mpscRing * r
+ * @param unsigned int pos
+ * @param unsigned int n
+ */
+void mpscPublish(mpscRing *r, unsigned int pos, unsigned int n) {
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		__atomic_store_n(&r->slots[(pos + i) & r->mask].seq, pos + i + 1, __ATOMIC_RELEASE);
+	}
+	queueWake(&r->head, &r->consumerSleeping);
+}
+
+/**
+ * Consumer: get the i-th oldest slot if it is filled
+ * @param mpscRing * r
+ * @param unsigned int i 0 for the oldest
+ * @return queueSlot * or NULL if not filled yet
+ */
+queueSlot * mpscPeek(mpscRing *r, unsigned int i) {
+	unsigned int pos = r->tail + i;
+	queueSlot *slot = &r->slots[pos & r->mask];
+
+	if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+		return NULL;
+	}
+
+	return slot;
+}
+
+/**
+ * Consumer: free the n oldest slots for the next lap
+ * @param mpscRing * r
+ * @param unsigned int n
+ */
+void mpscRelease(mpscRing *r, unsigned int n) {
+	unsigned int i, tail = r->tail, depth;
+
+	depth = __atomic_load_n(&r->head, __ATOMIC_RELAXED) - tail;
+	if (depth > r->highWater) {
+		r->highWater = depth;
+	}
+	for (i = 0; i < n; i++) {
+		__atomic_store_n(&r->slots[(tail + i) & r->mask].seq, tail + i + r->mask + 1, __ATOMIC_RELEASE);
+	}
+	__atomic_store_n(&r->tail, tail + n, __ATOMIC_RELEASE);
+	queueWake(&r->tail, &r->producerSleeping);
+}
+
+/**
+ * Consumer: sleep until a slot is claimed, a signal arrives or QUEUE_WAIT_MS
+ * passed. Slots claimed but not filled yet are only a few instructions away,
+ * then the thread just yields.
+ * @param mpscRing * r
+ */
+void mpscWait(mpscRing *r) {
+	if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) != r->tail) {
+		sched_yield();
+		return;
+	}
+	queueSleep(&r->head, r->tail, &r->consumerSleeping);
+}
+
+/**
+ * Number of slots claimed right now, for statistics
+ * @param mpscRing * r
+ * @return unsigned int
+ */
+unsigned int mpscDepth(mpscRing *r) {
+	return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+#ifdef	__cplusplus
+}
+#endif
@@ -0,0 +1,93 @@
+/* 
+ * Message queues between threads header
+ * 
+ * File:   queue.h
+ * Author: Andreas Behringer
+ * 
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifndef QUEUE_H
+#define	QUEUE_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <time.h>
+#include <netinet/in.h>
+
+#include "config.h"
+
+#define CACHELINE 64
+#define QUEUE_WAIT_MS 100				// longest sleep of a waiting thread
+#define QUEUE_BATCH 64					// slots the writer takes and gives back at once
+
+// Datagram as received, waiting for the writer thread
+typedef struct queueSlot {
+	unsigned int seq;					// lap of the slot, multi producer ring only
+	struct timespec time;				// arrival, from timestampClock()
+	struct sockaddr_in from;
+	size_t len;
+	char data[BUF];
+} __attribute__((aligned(CACHELINE))) queueSlot;
+
+// Single producer single consumer ring, counters run freely and wrap
+typedef struct spscRing {
+	// written by the producer only
+	unsigned int head __attribute__((aligned(CACHELINE)));	// slots published
+	unsigned int tailCache;				// tail as last seen by the producer
+	unsigned int fullWaits;				// producer had to wait for a free slot
+	// written by the consumer only
+	unsigned int tail __attribute__((aligned(CACHELINE)));	// slots released
+	unsigned int headCache;				// head as last seen by the consumer
+	unsigned int highWater;				// most slots seen filled at once
+	// number of threads sleeping on each side, rarely written
+	int producerSleeping __attribute__((aligned(CACHELINE)));
+	int consumerSleeping;
+	// constant after creation
+	unsigned int mask __attribute__((aligned(CACHELINE)));
+	queueSlot * slots;
+} spscRing;
+
+// Multi producer single consumer ring, a slot is free for position p when
+// its seq is p and filled when it is p + 1
+typedef struct mpscRing {
+	// claimed by producers with compare and swap
+	unsigned int head __attribute__((aligned(CACHELINE)));	// slots claimed
+	unsigned int claimRetries;			// claims lost to another producer
+	unsigned int fullWaits;				// producer had to wait for free slots
+	// written by the consumer only
+	unsigned int tail __attribute__((aligned(CACHELINE)));	// slots released
+	unsigned int highWater;				// most slots seen claimed at once
+	// number of threads sleeping on each side, rarely written
+	int producerSleeping __attribute__((aligned(CACHELINE)));
+	int consumerSleeping;
+	// constant after creation
+	unsigned int mask __attribute__((aligned(CACHELINE)));
+	queueSlot * slots;
+} mpscRing;
+
+spscRing * spscCreate(unsigned int slots);
+queueSlot * spscReserve(spscRing *r);
+void spscPublish(spscRing *r);
+queueSlot * spscPeek(spscRing *r, unsigned int i);
+void spscRelease(spscRing *r, unsigned int n);
+void spscWait(spscRing *r);
+unsigned int spscDepth(spscRing *r);
+mpscRing * mpscCreate(unsigned int slots);
+unsigned int mpscClaim(mpscRing *r, unsigned int n);
+queueSlot * mpscSlot(mpscRing *r, unsigned int pos);
+void mpscPublish(mpscRing *r, unsigned int pos, unsigned int n);
+queueSlot * mpscPeek(mpscRing *r, unsigned int i);
+void mpscRelease(mpscRing *r, unsigned int n);
+void mpscWait(mpscRing *r);
+unsigned int mpscDepth(mpscRing *r);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* QUEUE_H */
@@ -0,0 +1,469 @@
+/*
+ * Redis sink
+ *
+ * Commands go through an asynchronous hiredis context that never blocks the
+ * thread logging the messages. yaul has no event library, so the context is
+ * attached to a small adapter that only records whether hiredis waits for
+ * the socket to become readable or writable, and redisSinkFlush() polls the
+ * socket without timeout and hands the events to hiredis. It runs once
+ * --redis-batch values are queued and on every tick of the flush timer.
+ *
+ * Values are not sent one LPUSH each. They are copied into an arena and
+ * chained per list, and every list of the batch is sent with one LPUSH of
+ * all its values, so RESP framing and command dispatch in Redis are paid
+ * once per list instead of once per line.
+ *
+ * At most --redis-window commands wait for their reply, further values are
+ * dropped, the same as while there is no connection. A lost connection is
+ * opened again in the background, the pause between attempts doubles from
+ * REDIS_BACKOFF_MIN up to REDIS_BACKOFF_MAX ms.
+ *
+ * File:   redissink.c
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <syslog.h>
+
+#include "hiredis/hiredis.h"
+#include "hiredis/async.h"
+
+#include "config.h"
+#include "redissink.h"
+
+// provided by yaul.c
+extern struct yaulConfig config;
+extern unsigned int stat_redis_flushes;
+extern unsigned int stat_redis_commands;
+extern unsigned int stat_redis_drops;
+extern unsigned int stat_redis_lost;
+extern unsigned int stat_redis_reconnects;
+extern unsigned int stat_redis_pushes;
+extern unsigned long stat_redis_values;
+extern unsigned int stat_mallocs;
+
+// Value queued for a list
+struct sinkValue {
+	size_t offset;							// in the arena
+	size_t len;
+	unsigned int next;						// next value of the same list
+};
+
+// Values queued for the next LPUSH of a list
+struct sinkList {
+	unsigned int first;						// first value
+	unsigned int last;						// last value
+	unsigned int count;						// values, 0 = nothing queued
+	size_t bytes;							// bytes of all values
+	size_t key;								// offset of the key in the arena
+	size_t keylen;
+	long long expireat;						// EXPIREAT after the LPUSH, 0 = none
+};
+
+static redisAsyncContext *context = NULL;	// connection, NULL while there is none
+static int reading = 0;						// hiredis waits for a readable socket
+static int writing = 0;						// hiredis waits for a writable socket
+static int connected = 0;					// connection is established
+static unsigned int unsent = 0;				// commands queued since the last flush
+static unsigned int inflight = 0;			// commands without reply
+static unsigned int connection = 0;			// number of the current context, counts from 1
+static unsigned int backoff = REDIS_BACKOFF_MIN;	// ms before the next attempt after a failure
+static long long retry_at = 0;				// monotonic ms of the next connection attempt
+static struct sinkList *lists = NULL;		// values queued by list number
+static unsigned int nlists = 0;				// number of lists
+static unsigned int *active = NULL;			// lists that got values since the last flush
+static unsigned int nactive = 0;			// entries in active
+static struct sinkValue *values = NULL;		// values queued since the last flush
+static unsigned int values_used = 0;		// entries in values
+static char *arena = NULL;					// keys and values queued since the last flush
+static size_t arena_used = 0;				// bytes in arena
+static size_t arena_size = 0;				// capacity of arena
+static const char **argv = NULL;			// arguments of the LPUSH being formatted
+static size_t *argvlen = NULL;				// their lengths
+
+/**
+ * Milliseconds of the coarse monotonic clock
+ * @return long long
+ */
+static long long redisSinkNow(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static void redisSinkAddRead(void *privdata) {
+	reading = 1;
+}
+
+static void redisSinkDelRead(void *privdata) {
+	reading = 0;
+}
+
+static void redisSinkAddWrite(void *privdata) {
+	writing = 1;
+}
+
+static void redisSinkDelWrite(void *privdata) {
+	writing = 0;
+}
+
+/**
+ * Forget the connection and schedule the next attempt, once per connection
+ */
+static void redisSinkLost(void) {
+	context = NULL;
+	connected = 0;
+	retry_at = redisSinkNow() + backoff;
+	syslog(LOG_INFO, "Next redis connection attempt in %u ms", backoff);
+	backoff = (backoff * 2 > REDIS_BACKOFF_MAX) ? REDIS_BACKOFF_MAX : backoff * 2;
+}
+
+/**
+ * Called by hiredis whenever it frees the context, after a failed connect
+ * as well as after a lost connection
+ * @param void * privdata
+ */
+static void redisSinkCleanup(void *privdata) {
+	reading = 0;
+	writing = 0;
+	redisSinkLost();
+}
+
+/**
+ * Connect callback, the connection is established or failed
+ * @param const redisAsyncContext * ac
+ * @param int status
+ */
+static void redisSinkConnected(const redisAsyncContext *ac, int status) {
+	if (status != REDIS_OK) {
+		syslog(LOG_ERR, "Redis connection error at %s:%u: %s",
+				config.redis_ip, config.redis_port, ac->errstr);
+		return;
+	}
+	connected = 1;
+	backoff = REDIS_BACKOFF_MIN;
+	syslog(LOG_INFO, "Connected to redis at %s:%u", config.redis_ip, config.redis_port);
+}
+
+/**
+ * Disconnect callback, the replies still missing are lost
+ * @param const redisAsyncContext * ac
+ * @param int status
+ */
+static void redisSinkDisconnected(const redisAsyncContext *ac, int status) {
+	syslog(LOG_ERR, "Logging to redis failed at server %s:%u: %s",
+			config.redis_ip, config.redis_port, ac->errstr);
+}
+
+/**
+ * Reply callback of every command
+ * @param redisAsyncContext * ac
+ * @param void * reply NULL if the connection was lost before the reply
+ * @param void * privdata
+ */
+static void redisSinkReply(redisAsyncContext *ac, void *reply, void *privdata) {
+	inflight--;
+	if (reply == NULL) {
+		stat_redis_lost++;
+	}
+	// @todo catch redis reply for ttl error
+}
+
+/**
+ * Start connecting without waiting for the connection
+ */
+static void redisSinkConnect(void) {
+	redisAsyncContext *ac;
+
+	stat_redis_reconnects++;
+	connection++;
+	ac = redisAsyncConnect(config.redis_ip, config.redis_port);
+	if (ac == NULL || ac->err) {
+		syslog(LOG_ERR, "Redis connection error at %s:%u: %s",
+				config.redis_ip, config.redis_port, ac ? ac->errstr : "out of memory");
+		if (ac != NULL) {
+			// no cleanup hook set yet
+			redisAsyncFree(ac);
+		}
+		redisSinkLost();
+		return;
+	}
+	ac->ev.addRead = redisSinkAddRead;
+	ac->ev.delRead = redisSinkDelRead;
+	ac->ev.addWrite = redisSinkAddWrite;
+	ac->ev.delWrite = redisSinkDelWrite;
+	ac->ev.cleanup = redisSinkCleanup;
+	redisAsyncSetConnectCallback(ac, redisSinkConnected);
+	redisAsyncSetDisconnectCallback(ac, redisSinkDisconnected);
+	context = ac;
+}
+
+/**
+ * Check once that the server is reachable, with a blocking connection
+ * @return int 0 or -1 with the error on stderr
+ */
+int redisSinkCheck(void) {
+	struct timeval timeout = { 1, 500000 }; // 1.5 seconds
+	redisContext *c;
+	int rc = 0;
+
+	c = redisConnectWithTimeout(config.redis_ip, config.redis_port, timeout);
+	if (c == NULL || c->err) {
+		fprintf(stderr, "Redis connection error: %s\n", c ? c->errstr : "out of memory");
+		rc = -1;
+	}
+	if (c != NULL) {
+		redisFree(c);
+	}
+
+	return rc;
+}
+
+/**
+ * Copy bytes to the end of the arena, which grows as needed
+ * @param const struct iovec * iov
+ * @param int iovcnt
+ * @return size_t offset of the copy, pointers into the arena do not last
+ */
+static size_t redisSinkCopy(const struct iovec *iov, int iovcnt) {
+	size_t offset = arena_used, len = 0;
+	int i;
+
+	for (i = 0; i < iovcnt; i++) {
+		len += iov[i].iov_len;
+	}
+	if (arena_used + len > arena_size) {
+		while (arena_used + len > arena_size) {
+			arena_size *= 2;
+		}
+		arena = realloc(arena, arena_size);
+		stat_mallocs++;
+		if (arena == NULL) {
+			perror("Cannot allocate redis values");
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (i = 0; i < iovcnt; i++) {
+		memcpy(arena + arena_used, iov[i].iov_base, iov[i].iov_len);
+		arena_used += iov[i].iov_len;
+	}
+
+	return offset;
+}
+
+/**
+ * Queue one LPUSH with all values of a list, followed by its EXPIREAT
+ *
+ * The values are pushed in the order they came, the same as one LPUSH each.
+ * @param struct sinkList * l
+ */
+static void redisSinkEmit(struct sinkList *l) {
+	unsigned int i, n = 2;
+
+	argv[0] = "LPUSH";
+	argvlen[0] = 5;
+	argv[1] = arena + l->key;
+	argvlen[1] = l->keylen;
+	for (i = l->first; n < l->count + 2; i = values[i].next) {
+		argv[n] = arena + values[i].offset;
+		argvlen[n] = values[i].len;
+		n++;
+	}
+	if (context != NULL && redisAsyncCommandArgv(context, redisSinkReply, NULL, n, argv, argvlen) == REDIS_OK) {
+		inflight++;
+		unsent++;
+		stat_redis_pushes++;
+		stat_redis_values += l->count;
+		if (l->expireat > 0 && redisAsyncCommand(context, redisSinkReply, NULL, "EXPIREAT %b %lld",
+				arena + l->key, l->keylen, l->expireat) == REDIS_OK) {
+			inflight++;
+			unsent++;
+		}
+	} else {
+		stat_redis_drops += l->count;
+	}
+	l->count = 0;
+}
+
+/**
+ * Allocate the lists and the value table
+ * @param unsigned int count number of lists, one per logname id
+ */
+void redisSinkInit(unsigned int count) {
+	nlists = count;
+	lists = calloc(nlists, sizeof(struct sinkList));
+	active = malloc(config.redis_batch * sizeof(unsigned int));
+	values = malloc(config.redis_batch * sizeof(struct sinkValue));
+	argv = malloc((REDIS_PUSH_VALUES + 2) * sizeof(char *));
+	argvlen = malloc((REDIS_PUSH_VALUES + 2) * sizeof(size_t));
+	arena_size = config.buffer_size;
+	arena = malloc(arena_size);
+	if (lists == NULL || active == NULL || values == NULL || argv == NULL || argvlen == NULL || arena == NULL) {
+		perror("Cannot allocate redis lists");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/**
+ * Queue a value for the list key, connects if the time for the next attempt
+ * has come
+ *
+ * Values of the same list are pushed with one LPUSH when the batch is sent,
+ * or as soon as the list holds REDIS_PUSH_VALUES values or REDIS_PUSH_BYTES.
+ * @param unsigned int list number of the list, the logname id
+ * @param const char * key
+ * @param size_t keylen
+ * @param const struct iovec * value parts of the value
+ * @param int parts
+ * @param long long expireat send EXPIREAT key expireat after the LPUSH, 0 = not
+ * @return int 0 or -1 if the value was dropped
+ */
+int redisSinkPush(unsigned int list, const char *key, size_t keylen, const struct iovec *value, int parts, long long expireat) {
+	struct sinkList *l = &lists[list];
+	struct iovec iov;
+	unsigned int v;
+
+	if (context == NULL && redisSinkNow() >= retry_at) {
+		redisSinkConnect();
+	}
+	if (context != NULL && inflight >= config.redis_window) {
+		redisSinkFlush();
+	}
+	if (context == NULL || inflight >= config.redis_window) {
+		stat_redis_drops++;
+		return -1;
+	}
+
+	// values of another key, the list of the day before
+	if (l->count > 0 && (l->keylen != keylen || memcmp(arena + l->key, key, keylen) != 0)) {
+		redisSinkEmit(l);
+	}
+	if (l->count == 0) {
+		iov.iov_base = (void *) key;
+		iov.iov_len = keylen;
+		l->key = redisSinkCopy(&iov, 1);
+		l->keylen = keylen;
+		l->bytes = 0;
+		l->expireat = 0;
+		active[nactive++] = list;
+	}
+
+	v = values_used++;
+	values[v].offset = redisSinkCopy(value, parts);
+	values[v].len = arena_used - values[v].offset;
+	if (l->count == 0) {
+		l->first = v;
+	} else {
+		values[l->last].next = v;
+	}
+	l->last = v;
+	l->count++;
+	l->bytes += values[v].len;
+	if (expireat > 0) {
+		l->expireat = expireat;
+	}
+
+	if (l->count >= REDIS_PUSH_VALUES || l->bytes >= REDIS_PUSH_BYTES) {
+		redisSinkEmit(l);
+	}
+	if (values_used >= config.redis_batch) {
+		redisSinkFlush();
+	}
+
+	return 0;
+}
+
+/**
+ * Send queued commands and handle the replies that arrived, never waits
+ */
+void redisSinkFlush(void) {
+	struct pollfd pfd;
+	unsigned int i;
+
+	for (i = 0; i < nactive; i++) {
+		if (lists[active[i]].count > 0) {
+			redisSinkEmit(&lists[active[i]]);
+		}
+	}
+	nactive = 0;
+	values_used = 0;
+	arena_used = 0;
+
+	if (context == NULL) {
+		if (redisSinkNow() >= retry_at) {
+			redisSinkConnect();
+		}
+		return;
+	}
+	if (unsent > 0 && connected) {
+		stat_redis_flushes++;
+		stat_redis_commands += unsent;
+		unsent = 0;
+	}
+	pfd.fd = context->c.fd;
+	pfd.events = (reading ? POLLIN : 0) | (writing ? POLLOUT : 0);
+	pfd.revents = 0;
+	if (pfd.events == 0 || poll(&pfd, 1, 0) <= 0) {
+		return;
+	}
+	// errors show up as readable or writable, hiredis finds them then
+	if (reading && (pfd.revents & (POLLIN | POLLERR | POLLHUP))) {
+		redisAsyncHandleRead(context);
+	}
+	// the read may have lost the connection
+	if (context != NULL && writing && (pfd.revents & (POLLOUT | POLLERR | POLLHUP))) {
+		redisAsyncHandleWrite(context);
+	}
+}
+
+/**
+ * Send queued commands and wait for their replies, at most timeout ms
+ * @param unsigned int timeout
+ */
+void redisSinkDrain(unsigned int timeout) {
+	long long end = redisSinkNow() + timeout;
+	struct timespec wait = { 0, 1000000L };
+
+	redisSinkFlush();
+	while (context != NULL && inflight > 0 && redisSinkNow() < end) {
+		redisSinkFlush();
+		nanosleep(&wait, NULL);
+	}
+}
+
+/**
+ * Number of commands waiting for their reply
+ * @return unsigned int
+ */
+unsigned int redisSinkInflight(void) {
+	return inflight;
+}
+
+/**
+ * Number of the connection, changes whenever the sink connects again
+ *
+ * Commands that were queued on an earlier connection may be lost with it,
+ * callers use this to repeat them.
+ * @return unsigned int
+ */
+unsigned int redisSinkConnection(void) {
+	return connection;
+}
+
+#ifdef	__cplusplus
+}
+#endif
@@ -0,0 +1,38 @@
+/* 
+ * Redis sink header
+ * 
+ * File:   redissink.h
+ * Author: Andreas Behringer
+ * 
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifndef REDISSINK_H
+#define	REDISSINK_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define REDIS_BACKOFF_MIN 100				// ms before the first reconnect attempt
+#define REDIS_BACKOFF_MAX 10000				// longest pause between reconnect attempts in ms
+#define REDIS_DRAIN_MS 1000					// wait for replies at shutdown at most
+#define REDIS_PUSH_VALUES 256				// values of one LPUSH at most
+#define REDIS_PUSH_BYTES 262144				// bytes of one LPUSH, the list is sent once it holds more
+
+#include <sys/uio.h>
+
+int redisSinkCheck(void);
+void redisSinkInit(unsigned int count);
+int redisSinkPush(unsigned int list, const char *key, size_t keylen, const struct iovec *value, int parts, long long expireat);
+void redisSinkFlush(void);
+void redisSinkDrain(unsigned int timeout);
+unsigned int redisSinkInflight(void);
+unsigned int redisSinkConnection(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* REDISSINK_H */
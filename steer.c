@@ -0,0 +1,167 @@
+/*
+ * Logname steering program
+ *
+ * Classic BPF program for the SO_REUSEPORT group that picks the socket by a
+ * hash of the [logname] prefix of each datagram, so every logfile is written
+ * by exactly one worker. The program sees the UDP payload at offset 0.
+ *
+ * It has to agree with parseMessage() on every datagram: one that the parser
+ * logs to the default log yaul must go to the socket owning yaul, whatever
+ * its prefix looks like. So every byte of the logname is checked against the
+ * logname charset, an empty logname or a missing or empty message after it
+ * falls back too. Loads past the end of the datagram would end the program
+ * with socket 0, every load is preceded by a check of the datagram length.
+ *
+ * Loops are not possible in classic BPF and programs are limited to 4096
+ * instructions, so the scan is unrolled over the first STEER_NAMELENGTH bytes
+ * only. Longer lognames go to the socket of the default log, all of them to
+ * the same one.
+ *
+ * File:   steer.c
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <stdlib.h>
+
+#include "steer.h"
+
+#define STEER_STEP 20					// instructions per logname byte
+#define STEER_HASH 0					// scratch memory: hash of the logname so far
+#define STEER_LEN 1						// scratch memory: length of the datagram
+
+#define STMT(code, k) ((struct sock_filter) BPF_STMT(code, k))
+#define JUMP(code, k, jt, jf) ((struct sock_filter) BPF_JUMP(code, k, jt, jf))
+
+/**
+ * Hash the program computes over a logname: h = h * 31 + c
+ * @param const char * name
+ * @param size_t len
+ * @return unsigned int
+ */
+unsigned int steerHash(const char *name, size_t len) {
+	unsigned int h = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h = h * 31 + (unsigned char) name[i];
+	}
+
+	return h;
+}
+
+/**
+ * Socket of the default log yaul
+ * @param unsigned int nsocks
+ * @return unsigned int
+ */
+unsigned int steerFallback(unsigned int nsocks) {
+	return steerHash("yaul", 4) % nsocks;
+}
+
+/**
+ * Attach steering program to the SO_REUSEPORT group of sock
+ * @param int sock any socket of the group
+ * @param unsigned int nsocks sockets in the group
+ * @return int 0 on success, -1 on error with errno set
+ */
+int steerAttach(int sock, unsigned int nsocks) {
+	struct sock_filter *code;
+	struct sock_fprog prog;
+	unsigned int fallback, k, i = 0, j;
+	int rc;
+
+	fallback = steerFallback(nsocks);
+	code = calloc((STEER_NAMELENGTH + 2) * STEER_STEP + 16, sizeof(struct sock_filter));
+	if (code == NULL) {
+		return -1;
+	}
+	// at least "[", one logname char and "]"
+	code[i++] = STMT(BPF_LD | BPF_W | BPF_LEN, 0);
+	code[i++] = STMT(BPF_ST, STEER_LEN);
+	code[i++] = JUMP(BPF_JMP | BPF_JGE | BPF_K, 3, 1, 0);
+	code[i++] = STMT(BPF_RET | BPF_K, fallback);
+	code[i++] = STMT(BPF_LD | BPF_B | BPF_ABS, 0);
+	code[i++] = JUMP(BPF_JMP | BPF_JEQ | BPF_K, '[', 1, 0);
+	code[i++] = STMT(BPF_RET | BPF_K, fallback);
+	code[i++] = STMT(BPF_LD | BPF_IMM, 0);
+	code[i++] = STMT(BPF_ST, STEER_HASH);
+
+	for (k = 1; k <= STEER_NAMELENGTH; k++) {
+		// byte k exists
+		code[i++] = STMT(BPF_LD | BPF_MEM, STEER_LEN);
+		code[i++] = JUMP(BPF_JMP | BPF_JGT | BPF_K, k, 1, 0);
+		code[i++] = STMT(BPF_RET | BPF_K, fallback);
+		code[i++] = STMT(BPF_LD | BPF_B | BPF_ABS, k);
+		// closing bracket, after at least one logname char
+		if (k == 1) {
+			code[i++] = JUMP(BPF_JMP | BPF_JEQ | BPF_K, ']', 0, 1);
+			code[i++] = STMT(BPF_RET | BPF_K, fallback);
+		} else {
+			code[i++] = JUMP(BPF_JMP | BPF_JEQ | BPF_K, ']', 0, 2);
+			code[i++] = STMT(BPF_LDX | BPF_IMM, k);
+			// to the check after the closing bracket, set below
+			code[i++] = STMT(BPF_JMP | BPF_JA, 0);
+		}
+		// logname charset: the dot, 0-9, A-Z and a-z
+		code[i++] = JUMP(BPF_JMP | BPF_JEQ | BPF_K, '.', 7, 0);
+		code[i++] = JUMP(BPF_JMP | BPF_JGE | BPF_K, '0', 0, 5);
+		code[i++] = JUMP(BPF_JMP | BPF_JGT | BPF_K, '9', 0, 5);
+		code[i++] = JUMP(BPF_JMP | BPF_JGE | BPF_K, 'A', 0, 3);
+		code[i++] = JUMP(BPF_JMP | BPF_JGT | BPF_K, 'Z', 0, 3);
+		code[i++] = JUMP(BPF_JMP | BPF_JGE | BPF_K, 'a', 0, 1);
+		code[i++] = JUMP(BPF_JMP | BPF_JGT | BPF_K, 'z', 0, 1);
+		code[i++] = STMT(BPF_RET | BPF_K, fallback);
+		// h = h * 31 + c
+		code[i++] = STMT(BPF_MISC | BPF_TAX, 0);
+		code[i++] = STMT(BPF_LD | BPF_MEM, STEER_HASH);
+		code[i++] = STMT(BPF_ALU | BPF_MUL | BPF_K, 31);
+		code[i++] = STMT(BPF_ALU | BPF_ADD | BPF_X, 0);
+		code[i++] = STMT(BPF_ST, STEER_HASH);
+	}
+	// closing bracket at STEER_NAMELENGTH + 1 or logname too long
+	code[i++] = STMT(BPF_LD | BPF_MEM, STEER_LEN);
+	code[i++] = JUMP(BPF_JMP | BPF_JGT | BPF_K, STEER_NAMELENGTH + 1, 1, 0);
+	code[i++] = STMT(BPF_RET | BPF_K, fallback);
+	code[i++] = STMT(BPF_LD | BPF_B | BPF_ABS, STEER_NAMELENGTH + 1);
+	code[i++] = JUMP(BPF_JMP | BPF_JEQ | BPF_K, ']', 1, 0);
+	code[i++] = STMT(BPF_RET | BPF_K, fallback);
+	code[i++] = STMT(BPF_LDX | BPF_IMM, STEER_NAMELENGTH + 1);
+
+	// X is the index of the closing bracket, a message has to follow that
+	// does not start with a newline
+	for (j = 0; j < i; j++) {
+		if (code[j].code == (BPF_JMP | BPF_JA)) {
+			code[j].k = i - j - 1;
+		}
+	}
+	code[i++] = STMT(BPF_LD | BPF_MEM, STEER_LEN);
+	code[i++] = STMT(BPF_ALU | BPF_SUB | BPF_K, 1);
+	code[i++] = JUMP(BPF_JMP | BPF_JGT | BPF_X, 0, 1, 0);
+	code[i++] = STMT(BPF_RET | BPF_K, fallback);
+	code[i++] = STMT(BPF_LD | BPF_B | BPF_IND, 1);
+	code[i++] = JUMP(BPF_JMP | BPF_JEQ | BPF_K, '\n', 0, 1);
+	code[i++] = STMT(BPF_RET | BPF_K, fallback);
+	code[i++] = STMT(BPF_LD | BPF_MEM, STEER_HASH);
+	code[i++] = STMT(BPF_ALU | BPF_MOD | BPF_K, nsocks);
+	code[i++] = STMT(BPF_RET | BPF_A, 0);
+
+	prog.len = i;
+	prog.filter = code;
+	rc = setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+	free(code);
+
+	return rc;
+}
+
+#ifdef	__cplusplus
+}
+#endif
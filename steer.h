@@ -0,0 +1,30 @@
+/*
+ * Logname steering program header
+ *
+ * File:   steer.h
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifndef STEER_H
+#define	STEER_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#define STEER_NAMELENGTH 128			// longer lognames are steered like the default log
+
+unsigned int steerHash(const char *name, size_t len);
+unsigned int steerFallback(unsigned int nsocks);
+int steerAttach(int sock, unsigned int nsocks);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* STEER_H */
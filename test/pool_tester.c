@@ -0,0 +1,178 @@
+/*
+ * Stress test of the writer pool
+ *
+ * One producer spreads numbered lines over a few logfiles, in jobs of one to
+ * a few hundred lines, and now and then closes a logfile and opens it again
+ * or moves all logfiles to other lanes the way yaul does when it forgets the
+ * lognames. Afterwards every logfile has to hold all of its lines in order.
+ *
+ * File:   pool_tester.c
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../pool.h"
+
+#define WRITERS 4							// pool threads
+#define FILES 16							// logfiles written at once
+#define LANES 64							// lanes, more than logfiles like logname ids
+#define JOBS 200000							// write jobs in total
+#define MAXLINES 400						// lines per job at most
+#define REOPEN 500							// one in REOPEN jobs closes its logfile first
+#define RESET 20000							// jobs between moves of all logfiles to other lanes
+
+// counted by the pool, provided by yaul.c otherwise
+unsigned int stat_writes = 0;
+unsigned long stat_write_bytes = 0;
+unsigned int stat_mallocs = 0;
+
+static char dir[] = "/tmp/pool_tester.XXXXXX";
+static int fds[FILES];
+static unsigned int lines[FILES];			// lines queued per logfile
+
+/**
+ * Milliseconds of monotonic clock
+ * @return double
+ */
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * Path of a logfile
+ * @param unsigned int file
+ * @return const char *
+ */
+static const char * filePath(unsigned int file) {
+	static char path[sizeof(dir) + 16];
+
+	snprintf(path, sizeof(path), "%s/%u.log", dir, file);
+	return path;
+}
+
+/**
+ * Open logfile for appending, like openLogfile() does
+ * @param unsigned int file
+ */
+static void fileOpen(unsigned int file) {
+	fds[file] = open(filePath(file), O_WRONLY | O_APPEND | O_CREAT, 0644);
+	if (fds[file] < 0) {
+		perror("Cannot open logfile");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/**
+ * Read logfile back and check that it holds lines 0 to count - 1 in order
+ * @param unsigned int file
+ * @param unsigned int count
+ * @return int number of errors
+ */
+static int fileCheck(unsigned int file, unsigned int count) {
+	FILE *f;
+	unsigned int n, seen, expected = 0;
+	int errors = 0;
+
+	f = fopen(filePath(file), "r");
+	if (f == NULL) {
+		perror("Cannot read logfile");
+		return 1;
+	}
+	while (fscanf(f, "%u %u\n", &n, &seen) == 2) {
+		if (n != file || seen != expected) {
+			if (errors < 10) {
+				printf("  file %u: got line %u of file %u, expected %u\n", file, seen, n, expected);
+			}
+			errors++;
+		}
+		expected = seen + 1;
+	}
+	if (!feof(f)) {
+		printf("  file %u: garbage after line %u\n", file, expected);
+		errors++;
+	}
+	if (expected != count) {
+		printf("  file %u: %u of %u lines\n", file, expected, count);
+		errors++;
+	}
+	fclose(f);
+	unlink(filePath(file));
+
+	return errors;
+}
+
+int main(int argc, char **argv) {
+	struct iovec iov[2];
+	char *buffer;
+	size_t len, half;
+	unsigned int job, file, count, i, shift = 0, seed = 1, reopens = 0, resets = 0;
+	double start;
+	int errors = 0;
+
+	if (mkdtemp(dir) == NULL) {
+		perror("Cannot create directory");
+		return EXIT_FAILURE;
+	}
+	buffer = malloc(MAXLINES * 32);
+	for (file = 0; file < FILES; file++) {
+		fileOpen(file);
+	}
+	poolStart(WRITERS, LANES);
+
+	start = now();
+	for (job = 0; job < JOBS; job++) {
+		file = rand_r(&seed) % FILES;
+		// mostly single lines like --flush 1, sometimes whole buffers
+		count = (rand_r(&seed) % 8 == 0) ? 1 + rand_r(&seed) % MAXLINES : 1;
+		for (len = 0, i = 0; i < count; i++) {
+			len += sprintf(buffer + len, "%u %u\n", file, lines[file]++);
+		}
+		if (rand_r(&seed) % REOPEN == 0) {
+			poolClose(file + shift, fds[file]);
+			fileOpen(file);
+			reopens++;
+		}
+		// two parts, the way lines too large for the buffer are written
+		half = len / 2;
+		iov[0].iov_base = buffer;
+		iov[0].iov_len = half;
+		iov[1].iov_base = buffer + half;
+		iov[1].iov_len = len - half;
+		poolWrite(file + shift, fds[file], iov, 2);
+		if (job % RESET == RESET - 1) {
+			// new logname ids pick other lanes, the old ones have to finish first
+			poolDrain();
+			shift = (shift + FILES) % (LANES - FILES + 1);
+			resets++;
+		}
+	}
+	for (file = 0; file < FILES; file++) {
+		poolClose(file + shift, fds[file]);
+	}
+	poolDrain();
+
+	printf("%u jobs of %u logfiles %8.1f ms %u writes %lu bytes %u reopens %u resets %u laneruns %u lanesteals %u mallocs\n",
+			JOBS, FILES, now() - start, stat_writes, stat_write_bytes, reopens, resets, poolRuns(), poolSteals(), stat_mallocs);
+	for (file = 0; file < FILES; file++) {
+		errors += fileCheck(file, lines[file]);
+	}
+	rmdir(dir);
+	free(buffer);
+	printf("%s\n", errors ? "FAILED" : "ok");
+
+	return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
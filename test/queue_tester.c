@@ -0,0 +1,245 @@
+/*
+ * Stress test of the rings between receive and writer threads
+ *
+ * Producers push numbered items through a ring of a few slots, so both sides
+ * keep running into a full or empty ring and go to sleep. The consumer checks
+ * that every producer's items arrive complete and in order. A side that
+ * sleeps the whole QUEUE_WAIT_MS although the other one kept going missed its
+ * wake up, those waits are counted and fail the test.
+ *
+ * File:   queue_tester.c
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../queue.h"
+
+#define ITEMS 200000						// items per producer
+#define SLOTS 8								// ring size, small to wait often
+#define MAXPRODUCERS 8
+#define MISSED_MS (QUEUE_WAIT_MS * 9 / 10)	// a wait this long missed its wake up
+#define MAXMISSED 10						// missed wake ups before giving up
+
+// Item as stored in the data of a slot
+struct item {
+	unsigned int producer;
+	unsigned int seq;
+};
+
+static spscRing *spsc;
+static mpscRing *mpsc;
+static unsigned int producers;
+static unsigned int missed = 0;				// waits that ran into the timeout
+
+/**
+ * Milliseconds of monotonic clock
+ * @return double
+ */
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * Count a wait that took until the timeout, give up after MAXMISSED of them
+ * instead of crawling on at one item per timeout
+ * @param double start
+ */
+static void checkWait(double start) {
+	if (now() - start >= MISSED_MS && __atomic_add_fetch(&missed, 1, __ATOMIC_RELAXED) >= MAXMISSED) {
+		printf("%u waits missed their wake up  FAILED\n", MAXMISSED);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/**
+ * Producer of the single producer ring
+ * @param void * arg unused
+ * @return void *
+ */
+static void * spscProducer(void *arg) {
+	queueSlot *slot;
+	struct item item = { 0, 0 };
+	double start;
+
+	for (item.seq = 0; item.seq < ITEMS; item.seq++) {
+		start = now();
+		slot = spscReserve(spsc);
+		checkWait(start);
+		memcpy(slot->data, &item, sizeof(item));
+		slot->len = sizeof(item);
+		spscPublish(spsc);
+	}
+
+	return NULL;
+}
+
+/**
+ * Producer of the multi producer ring, claims batches of 1 to 4 slots
+ * @param void * arg producer number
+ * @return void *
+ */
+static void * mpscProducer(void *arg) {
+	struct item item;
+	unsigned int pos, n, i, seed;
+	double start;
+
+	item.producer = (unsigned int) (unsigned long) arg;
+	item.seq = 0;
+	seed = item.producer + 1;
+	while (item.seq < ITEMS) {
+		n = 1 + rand_r(&seed) % 4;
+		if (n > ITEMS - item.seq) {
+			n = ITEMS - item.seq;
+		}
+		start = now();
+		pos = mpscClaim(mpsc, n);
+		checkWait(start);
+		for (i = 0; i < n; i++, item.seq++) {
+			memcpy(mpscSlot(mpsc, pos + i)->data, &item, sizeof(item));
+			mpscSlot(mpsc, pos + i)->len = sizeof(item);
+		}
+		mpscPublish(mpsc, pos, n);
+	}
+
+	return NULL;
+}
+
+/**
+ * Take all items of all producers and check their order
+ * @param int multi use the multi producer ring
+ * @return int number of errors
+ */
+static int consume(int multi) {
+	unsigned int expected[MAXPRODUCERS];
+	unsigned int received = 0, total, n;
+	queueSlot *slot;
+	struct item item;
+	double start;
+	int errors = 0;
+
+	memset(expected, 0, sizeof(expected));
+	total = producers * ITEMS;
+	while (received < total) {
+		for (n = 0; n < QUEUE_BATCH; n++) {
+			slot = multi ? mpscPeek(mpsc, n) : spscPeek(spsc, n);
+			if (slot == NULL) {
+				break;
+			}
+			memcpy(&item, slot->data, sizeof(item));
+			if (slot->len != sizeof(item) || item.producer >= producers) {
+				printf("  slot %u: garbage\n", received + n);
+				errors++;
+				continue;
+			}
+			if (item.seq != expected[item.producer]) {
+				if (errors < 10) {
+					printf("  producer %u: got item %u, expected %u\n", item.producer, item.seq, expected[item.producer]);
+				}
+				errors++;
+			}
+			expected[item.producer] = item.seq + 1;
+		}
+		if (n == 0) {
+			start = now();
+			if (multi) {
+				mpscWait(mpsc);
+			} else {
+				spscWait(spsc);
+			}
+			checkWait(start);
+			continue;
+		}
+		if (multi) {
+			mpscRelease(mpsc, n);
+		} else {
+			spscRelease(spsc, n);
+		}
+		received += n;
+	}
+	for (n = 0; n < producers; n++) {
+		if (expected[n] != ITEMS) {
+			printf("  producer %u: %u of %u items\n", n, expected[n], ITEMS);
+			errors++;
+		}
+	}
+
+	return errors;
+}
+
+/**
+ * Run one round with a fresh ring
+ * @param int multi use the multi producer ring
+ * @param unsigned int count number of producers
+ * @return int number of errors
+ */
+static int run(int multi, unsigned int count) {
+	pthread_t threads[MAXPRODUCERS];
+	unsigned int i, waits;
+	double start;
+	int errors;
+
+	producers = count;
+	missed = 0;
+	if (multi) {
+		mpsc = mpscCreate(SLOTS);
+	} else {
+		spsc = spscCreate(SLOTS);
+	}
+	if (mpsc == NULL && spsc == NULL) {
+		perror("Cannot create ring");
+		exit(EXIT_FAILURE);
+	}
+
+	start = now();
+	for (i = 0; i < producers; i++) {
+		if (pthread_create(&threads[i], NULL, multi ? mpscProducer : spscProducer, (void *) (unsigned long) i) != 0) {
+			perror("Cannot start producer");
+			exit(EXIT_FAILURE);
+		}
+	}
+	errors = consume(multi);
+	for (i = 0; i < producers; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	waits = multi ? mpsc->fullWaits : spsc->fullWaits;
+	errors += missed;
+
+	printf("%-5s %2u producers %9u items %8.1f ms %8u full waits %4u missed wake ups  %s\n",
+			multi ? "mpsc" : "spsc", producers, producers * ITEMS, now() - start,
+			waits, missed, errors ? "FAILED" : "ok");
+
+	if (multi) {
+		free(mpsc->slots);
+		free(mpsc);
+		mpsc = NULL;
+	} else {
+		free(spsc->slots);
+		free(spsc);
+		spsc = NULL;
+	}
+
+	return errors;
+}
+
+int main(int argc, char **argv) {
+	int errors = 0;
+
+	errors += run(0, 1);
+	errors += run(1, 1);
+	errors += run(1, 2);
+	errors += run(1, 4);
+	errors += run(1, MAXPRODUCERS);
+
+	return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,177 @@
+/*
+ * Test of the logname steering program
+ *
+ * Binds a SO_REUSEPORT group of sockets on the loopback interface, attaches
+ * the steering program and sends datagrams to it one at a time. Every
+ * datagram has to arrive at the socket of its logname if parseMessage()
+ * accepts the logname, and at the socket of the default log otherwise: bad
+ * chars, an empty logname, no message after it, short datagrams and lognames
+ * longer than STEER_NAMELENGTH. Random prefixes made of brackets, logname
+ * chars and a few others follow.
+ *
+ * File:   steer_tester.c
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../config.h"
+#include "../parser.h"
+#include "../steer.h"
+
+#define SOCKS 4								// the default log is not on socket 0
+#define RANDOM 5000							// random datagrams
+
+static int socks[SOCKS];
+static int sender;
+static struct sockaddr_in addr;
+
+static const char *cases[] = {
+	"[a.b]msg",
+	"[Web01.access]GET /",
+	"[x]y",
+	"[a.b]msg\nsecond line",
+	"[a b]msg",
+	"[a/b]msg",
+	"[a-b]msg",
+	"[a.b\x0e]msg",
+	"[a.b\xe9]msg",
+	"[]msg",
+	"[a.b]",
+	"[a.b]\nmsg",
+	"[a.b",
+	"[ab",
+	"[a]",
+	"[",
+	"x",
+	"",
+	"plain line",
+	"[[a]]x",
+	"]a[x",
+};
+
+/**
+ * Open socket of the group, the first one picks the port
+ * @return int
+ */
+static int openSocket(void) {
+	int s, on = 1;
+	socklen_t len = sizeof(addr);
+
+	s = socket(AF_INET, SOCK_DGRAM, 0);
+	setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+	if (bind(s, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		perror("Cannot bind socket");
+		exit(EXIT_FAILURE);
+	}
+	getsockname(s, (struct sockaddr *) &addr, &len);
+
+	return s;
+}
+
+/**
+ * Socket the parser and the steering program should pick for a datagram
+ * @param const char * data
+ * @param size_t len
+ * @return unsigned int
+ */
+static unsigned int expectedSocket(const char *data, size_t len) {
+	parsedMessage msg;
+
+	if (!parseMessage(data, len, &msg) || msg.namelen > STEER_NAMELENGTH) {
+		return steerFallback(SOCKS);
+	}
+
+	return steerHash(msg.name, msg.namelen) % SOCKS;
+}
+
+/**
+ * Send datagram and check which socket receives it
+ * @param const char * data
+ * @param size_t len
+ * @return int 1 if it arrived at the expected socket
+ */
+static int check(const char *data, size_t len) {
+	struct pollfd pfd[SOCKS];
+	char buffer[BUF];
+	unsigned int i, expected;
+	int shown = len < 40 ? (int) len : 40, got = -1;
+
+	expected = expectedSocket(data, len);
+	sendto(sender, data, len, 0, (struct sockaddr *) &addr, sizeof(addr));
+	for (i = 0; i < SOCKS; i++) {
+		pfd[i].fd = socks[i];
+		pfd[i].events = POLLIN;
+	}
+	if (poll(pfd, SOCKS, 1000) <= 0) {
+		printf("  \"%.*s\": lost\n", shown, data);
+		return 0;
+	}
+	for (i = 0; i < SOCKS; i++) {
+		if (pfd[i].revents & POLLIN) {
+			recv(socks[i], buffer, sizeof(buffer), 0);
+			got = i;
+		}
+	}
+	if (got != (int) expected) {
+		printf("  \"%.*s\" (%lu bytes): socket %d, expected %u\n", shown, data, (unsigned long) len, got, expected);
+		return 0;
+	}
+
+	return 1;
+}
+
+int main(int argc, char **argv) {
+	static const char chars[] = "[[]].ab9Z -/\n\x01";
+	char data[STEER_NAMELENGTH * 2 + 16];
+	unsigned int i, k, len, seed = 1, passed = 0, total = 0;
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	for (i = 0; i < SOCKS; i++) {
+		socks[i] = openSocket();
+	}
+	sender = socket(AF_INET, SOCK_DGRAM, 0);
+	if (steerAttach(socks[0], SOCKS) < 0) {
+		perror("Cannot attach logname steering program");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++, total++) {
+		passed += check(cases[i], strlen(cases[i]));
+	}
+
+	// lognames around the longest one the program hashes
+	for (len = STEER_NAMELENGTH - 1; len <= STEER_NAMELENGTH + 2; len++, total++) {
+		data[0] = '[';
+		for (k = 1; k <= len; k++) {
+			data[k] = 'a' + k % 26;
+		}
+		strcpy(data + len + 1, "]msg");
+		passed += check(data, len + 5);
+	}
+
+	for (i = 0; i < RANDOM; i++, total++) {
+		len = rand_r(&seed) % 12;
+		data[0] = '[';
+		for (k = 1; k < len; k++) {
+			data[k] = chars[rand_r(&seed) % (sizeof(chars) - 1)];
+		}
+		passed += check(data, len);
+	}
+
+	printf("%u of %u datagrams steered like the parser  %s\n", passed, total, passed == total ? "ok" : "FAILED");
+
+	return passed == total ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,154 @@
+/*
+ * Timestamp cache
+ *
+ * Log lines carry the local time as "%Y-%m-%d %H:%M:%S", Redis lists the day
+ * as "%Y-%m-%d". Both strings are formatted only when the second changes,
+ * all other messages of that second reuse them. The end of the day is only
+ * computed when the day changes. With a precision of 3 or 6
+ * digits the milli- or microseconds are appended to the cached string.
+ *
+ * Reading the clock and formatting are separate, so the time can be taken
+ * when a datagram arrives and formatted later by the thread writing it. Only
+ * one thread may format.
+ *
+ * File:   timestamp.c
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <string.h>
+#include <time.h>
+
+#include "timestamp.h"
+
+static unsigned int precision = 0;				// digits of the second fraction: 0, 3 or 6
+static time_t cachedSecond = (time_t) -1;		// second the strings were formatted for
+static size_t cachedLength = 0;					// length of timestamp without fraction
+static char cachedTime[TIMESTAMP_LENGTH];		// "%Y-%m-%d %H:%M:%S[.fraction]"
+static char cachedDate[DATE_LENGTH];			// "%Y-%m-%d"
+static time_t cachedDayEnd = 0;					// local midnight after cachedDate
+
+/**
+ * Set number of fraction digits and drop cached strings
+ *
+ * @param unsigned int digits 0 for seconds, 3 for milli-, 6 for microseconds
+ */
+void timestampInit(unsigned int digits) {
+	precision = digits;
+	cachedSecond = (time_t) -1;
+}
+
+/**
+ * Format cached strings for a new second
+ *
+ * tzset() and localtime_r() run once per second only, so changes of the
+ * timezone or daylight saving time show up with the next second.
+ *
+ * @param time_t now
+ */
+static void timestampUpdate(time_t now) {
+	struct tm timeinfo;
+
+	tzset();
+	localtime_r(&now, &timeinfo);
+	cachedLength = strftime(cachedTime, TIMESTAMP_LENGTH, "%Y-%m-%d %H:%M:%S", &timeinfo);
+	// the date is the leading part of the timestamp
+	if (memcmp(cachedDate, cachedTime, DATE_LENGTH - 1) != 0) {
+		memcpy(cachedDate, cachedTime, DATE_LENGTH - 1);
+		cachedDate[DATE_LENGTH - 1] = '\0';
+		timeinfo.tm_sec = 0;
+		timeinfo.tm_min = 0;
+		timeinfo.tm_hour = 0;
+		timeinfo.tm_mday++;
+		timeinfo.tm_isdst = -1;
+		cachedDayEnd = mktime(&timeinfo);
+	}
+	cachedSecond = now;
+}
+
+/**
+ * Read the clock as precise as the timestamps need it, safe in any thread
+ *
+ * Milliseconds come from CLOCK_REALTIME_COARSE, which costs no more than
+ * time() but only moves once per kernel tick. Microseconds need the precise
+ * CLOCK_REALTIME, both are served by the vDSO without a syscall.
+ *
+ * @param struct timespec * ts
+ */
+void timestampClock(struct timespec *ts) {
+	if (precision == 0) {
+		ts->tv_sec = time(NULL);
+		ts->tv_nsec = 0;
+	} else {
+		clock_gettime(precision == 3 ? CLOCK_REALTIME_COARSE : CLOCK_REALTIME, ts);
+	}
+}
+
+/**
+ * Time read by timestampClock() as string, valid until the next call
+ *
+ * @param const struct timespec * ts
+ * @param size_t * len length of the returned string
+ * @return const char *
+ */
+const char * timestampFormat(const struct timespec *ts, size_t *len) {
+	unsigned long fraction;
+	char *p;
+	unsigned int i;
+
+	if (ts->tv_sec != cachedSecond) {
+		timestampUpdate(ts->tv_sec);
+	}
+
+	if (precision > 0) {
+		fraction = ts->tv_nsec / (precision == 3 ? 1000000 : 1000);
+		p = cachedTime + cachedLength;
+		p[0] = '.';
+		for (i = precision; i > 0; i--) {
+			p[i] = '0' + fraction % 10;
+			fraction /= 10;
+		}
+		p[precision + 1] = '\0';
+		*len = cachedLength + precision + 1;
+	} else {
+		*len = cachedLength;
+	}
+
+	return cachedTime;
+}
+
+/**
+ * Day of the last timestamp as string, for Redis list names
+ *
+ * @return const char *
+ */
+const char * timestampDate(void) {
+	if (cachedSecond == (time_t) -1) {
+		timestampUpdate(time(NULL));
+	}
+
+	return cachedDate;
+}
+
+/**
+ * End of the day of the last timestamp, the local midnight after it
+ *
+ * @return time_t
+ */
+time_t timestampDayEnd(void) {
+	if (cachedSecond == (time_t) -1) {
+		timestampUpdate(time(NULL));
+	}
+
+	return cachedDayEnd;
+}
+
+#ifdef	__cplusplus
+}
+#endif
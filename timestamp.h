@@ -0,0 +1,34 @@
+/* 
+ * Timestamp cache header
+ * 
+ * File:   timestamp.h
+ * Author: Andreas Behringer
+ * 
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifndef TIMESTAMP_H
+#define	TIMESTAMP_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <time.h>
+
+#define TIMESTAMP_LENGTH 32				// "%Y-%m-%d %H:%M:%S" plus fraction
+#define DATE_LENGTH 11					// "%Y-%m-%d"
+
+void timestampInit(unsigned int precision);
+void timestampClock(struct timespec *ts);
+const char * timestampFormat(const struct timespec *ts, size_t *len);
+const char * timestampDate(void);
+time_t timestampDayEnd(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* TIMESTAMP_H */
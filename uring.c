@@ -0,0 +1,661 @@
+/*
+ * io_uring ingest engine
+ *
+ * Datagrams are received by one multishot recvmsg request into a ring of
+ * provided buffers, so the kernel keeps posting completions without a new
+ * request per message. Flushes of the logfile buffers are queued as write
+ * requests on the same ring and go out with the next io_uring_enter() call
+ * together with the wait for more datagrams. Completed write requests and
+ * closed logfiles are kept for reuse, so a steady stream of flushes does not
+ * allocate.
+ *
+ * File:   uring.c
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <linux/io_uring.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <syslog.h>
+
+#include "config.h"
+#include "uring.h"
+
+// provided by yaul.c
+extern unsigned int stat_batches;
+extern unsigned int stat_batch_messages;
+extern unsigned int stat_mallocs;
+void handleDatagram(const char *buffer, size_t len, struct sockaddr_in *cliAddr);
+void checkFlush(void);
+
+#define URING_RECV 1						// user_data of the multishot recvmsg
+#define URING_BUFLEN (sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + BUF)
+#define URING_FREEWRITES 64					// completed write requests kept for reuse
+#define URING_MAXERRORS 16					// failed io_uring_enter() calls in a row before falling back
+
+// Write request of a logfile stream, queued until the previous one is done
+struct uringWrite {
+	struct uringWrite *next;
+	struct uringFile *file;
+	size_t size;							// capacity of data
+	size_t len;
+	size_t done;
+	char data[];
+};
+
+// Logfile opened through the ring
+struct uringFile {
+	int fd;
+	int closing;
+	struct uringWrite *head;
+	struct uringWrite *tail;
+	struct uringFile *prev;					// list of open files
+	struct uringFile *next;					// list of open files, free list once closed
+};
+
+// Mapped submission and completion queues
+struct uringRing {
+	int fd;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned sq_entries;
+	unsigned sqe_tail;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	char *sq_ptr;							// mappings, released by uringRelease()
+	size_t sq_len;
+	char *cq_ptr;
+	size_t cq_len;
+	size_t sqes_len;
+};
+
+static struct uringRing ring = { -1 };
+static struct io_uring_buf_ring *buf_ring = NULL;	// ring of provided receive buffers
+static char *buffers = NULL;				// memory behind the provided buffers
+static struct msghdr recv_msg;				// template for the multishot recvmsg
+static int recv_sock = -1;					// socket the engine receives from
+static unsigned int writes_pending = 0;		// write requests not yet completed
+static struct uringWrite *writes_free = NULL;	// completed write requests for reuse
+static unsigned int writes_free_count = 0;
+static struct uringFile *files_free = NULL;	// closed logfiles for reuse
+static struct uringFile *files_open = NULL;	// logfiles taken over by uringOpen()
+
+/**
+ * Get write request for len bytes, reusing a completed one if it fits
+ *
+ * New requests hold at least a whole append buffer, so every later flush
+ * fits into them.
+ * @param size_t len
+ * @return struct uringWrite * or NULL if out of memory
+ */
+static struct uringWrite * uringWriteAlloc(size_t len) {
+	struct uringWrite *w = writes_free;
+	size_t size;
+
+	if (w != NULL && w->size >= len) {
+		writes_free = w->next;
+		writes_free_count--;
+		return w;
+	}
+	size = (len > config.buffer_size) ? len : config.buffer_size;
+	w = malloc(sizeof(struct uringWrite) + size);
+	stat_mallocs++;
+	if (w != NULL) {
+		w->size = size;
+	}
+
+	return w;
+}
+
+/**
+ * Keep completed write request for reuse, or free it if enough are kept
+ * @param struct uringWrite * w
+ */
+static void uringWriteRelease(struct uringWrite *w) {
+	if (writes_free_count < URING_FREEWRITES) {
+		w->next = writes_free;
+		writes_free = w;
+		writes_free_count++;
+	} else {
+		free(w);
+	}
+}
+
+/**
+ * Close file and keep its record for reuse
+ * @param struct uringFile * file
+ */
+static void uringFileRelease(struct uringFile *file) {
+	close(file->fd);
+	if (file->prev != NULL) {
+		file->prev->next = file->next;
+	} else {
+		files_open = file->next;
+	}
+	if (file->next != NULL) {
+		file->next->prev = file->prev;
+	}
+	file->next = files_free;
+	files_free = file;
+}
+
+/**
+ * Get next free submission queue entry, submitting queued ones if full
+ * @return struct io_uring_sqe *
+ */
+static struct io_uring_sqe * uringGetSqe(void) {
+	struct io_uring_sqe *sqe;
+	unsigned head;
+
+	head = __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+	while (ring.sqe_tail - head >= ring.sq_entries) {
+		__atomic_store_n(ring.sq_tail, ring.sqe_tail, __ATOMIC_RELEASE);
+		syscall(__NR_io_uring_enter, ring.fd, ring.sqe_tail - head, 0, 0, NULL, 0);
+		head = __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+	}
+
+	sqe = &ring.sqes[ring.sqe_tail & *ring.sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	ring.sq_array[ring.sqe_tail & *ring.sq_mask] = ring.sqe_tail & *ring.sq_mask;
+	ring.sqe_tail++;
+
+	return sqe;
+}
+
+/**
+ * Submit queued requests and wait for completions in one syscall
+ * @param unsigned int wait minimum number of completions to wait for
+ * @return int
+ */
+static int uringEnter(unsigned int wait) {
+	unsigned submit;
+
+	submit = ring.sqe_tail - *ring.sq_tail;
+	__atomic_store_n(ring.sq_tail, ring.sqe_tail, __ATOMIC_RELEASE);
+
+	return syscall(__NR_io_uring_enter, ring.fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+/**
+ * Give receive buffer back to the kernel
+ * @param unsigned short bid
+ */
+static void uringRecycle(unsigned short bid) {
+	struct io_uring_buf *buf;
+	unsigned short tail = buf_ring->tail;
+
+	buf = &buf_ring->bufs[tail & (URING_BUFFERS - 1)];
+	buf->addr = (unsigned long) (buffers + bid * URING_BUFLEN);
+	buf->len = URING_BUFLEN;
+	buf->bid = bid;
+	__atomic_store_n(&buf_ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Queue the multishot recvmsg request, again whenever the kernel ended it
+ */
+static void uringArmRecv(void) {
+	struct io_uring_sqe *sqe = uringGetSqe();
+
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = recv_sock;
+	sqe->addr = (unsigned long) &recv_msg;
+	sqe->len = 1;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = 0;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->user_data = URING_RECV;
+}
+
+/**
+ * Queue the first waiting write request of a logfile
+ * @param struct uringFile * file
+ */
+static void uringSubmitWrite(struct uringFile *file) {
+	struct io_uring_sqe *sqe = uringGetSqe();
+	struct uringWrite *w = file->head;
+
+	sqe->opcode = IORING_OP_WRITE;
+	sqe->fd = file->fd;
+	sqe->addr = (unsigned long) (w->data + w->done);
+	sqe->len = w->len - w->done;
+	sqe->off = (unsigned long long) -1;
+	sqe->user_data = (unsigned long) w;
+}
+
+/**
+ * Handle completed write request and start the next one of the same file
+ *
+ * Only one write per file is in flight at a time, so lines keep their order.
+ * @param struct uringWrite * w
+ * @param int res
+ */
+static void uringWriteDone(struct uringWrite *w, int res) {
+	struct uringFile *file = w->file;
+
+	if (res < 0) {
+		syslog(LOG_ERR, "Cannot write logfile: %s", strerror(-res));
+	} else if (res == 0 && w->done < w->len) {
+		syslog(LOG_ERR, "Cannot write logfile: no progress, %lu bytes lost", (unsigned long) (w->len - w->done));
+	} else if (w->done + res < w->len) {
+		// short write, queue the rest
+		w->done += res;
+		uringSubmitWrite(file);
+		return;
+	}
+
+	file->head = w->next;
+	if (file->head == NULL) {
+		file->tail = NULL;
+	}
+	uringWriteRelease(w);
+	writes_pending--;
+
+	if (file->head != NULL) {
+		uringSubmitWrite(file);
+	} else if (file->closing) {
+		uringFileRelease(file);
+	}
+}
+
+/**
+ * Process all available completions
+ * @param int deliver hand received datagrams to the logger or just drop them
+ * @return int 0 if the kernel refused the multishot request
+ */
+static int uringReap(int deliver) {
+	struct io_uring_cqe *cqe;
+	struct io_uring_recvmsg_out *out;
+	struct sockaddr_in *cliAddr;
+	unsigned head, tail, flags;
+	unsigned long long user_data;
+	unsigned short bid;
+	unsigned int received = 0;
+	char *buf, *payload;
+	size_t len;
+	int res;
+
+	head = *ring.cq_head;
+	tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+	while (head != tail) {
+		cqe = &ring.cqes[head & *ring.cq_mask];
+		user_data = cqe->user_data;
+		res = cqe->res;
+		flags = cqe->flags;
+		__atomic_store_n(ring.cq_head, ++head, __ATOMIC_RELEASE);
+
+		if (user_data != URING_RECV) {
+			uringWriteDone((struct uringWrite *) (unsigned long) user_data, res);
+			continue;
+		}
+
+		if (!(flags & IORING_CQE_F_MORE)) {
+			if (res == -EINVAL || res == -EOPNOTSUPP) {
+				return 0;
+			}
+			uringArmRecv();
+		}
+		if (res < 0 || !(flags & IORING_CQE_F_BUFFER)) {
+			if (res != -ENOBUFS) {
+				syslog(LOG_ERR, "cannot receive data");
+			}
+			continue;
+		}
+
+		bid = flags >> IORING_CQE_BUFFER_SHIFT;
+		buf = buffers + bid * URING_BUFLEN;
+		out = (struct io_uring_recvmsg_out *) buf;
+		cliAddr = (struct sockaddr_in *) (out + 1);
+		payload = (char *) (out + 1) + recv_msg.msg_namelen + recv_msg.msg_controllen;
+		len = res - (payload - buf);
+		if (out->payloadlen < len) {
+			len = out->payloadlen;
+		}
+
+		if (deliver) {
+			handleDatagram(payload, len, cliAddr);
+			received++;
+		}
+		uringRecycle(bid);
+	}
+
+	if (received > 0) {
+		stat_batches++;
+		stat_batch_messages += received;
+	}
+
+	return 1;
+}
+
+/**
+ * Unmap and free everything uringInit() set up and close the ring
+ */
+static void uringRelease(void) {
+	if (buffers != NULL) {
+		free(buffers);
+		buffers = NULL;
+	}
+	if (buf_ring != NULL) {
+		munmap(buf_ring, URING_BUFFERS * sizeof(struct io_uring_buf));
+		buf_ring = NULL;
+	}
+	if (ring.sqes != NULL) {
+		munmap(ring.sqes, ring.sqes_len);
+	}
+	if (ring.cq_ptr != NULL && ring.cq_ptr != ring.sq_ptr) {
+		munmap(ring.cq_ptr, ring.cq_len);
+	}
+	if (ring.sq_ptr != NULL) {
+		munmap(ring.sq_ptr, ring.sq_len);
+	}
+	if (ring.fd >= 0) {
+		close(ring.fd);
+	}
+	memset(&ring, 0, sizeof(ring));
+	ring.fd = -1;
+}
+
+/**
+ * Set up ring and provided buffers for receiving from socket s
+ * @param int s
+ * @return int 0 on success, -1 if io_uring is not available
+ */
+int uringInit(int s) {
+	struct io_uring_params p;
+	struct io_uring_buf_reg reg;
+	struct io_uring_sqe *sqes;
+	char *sq_ptr, *cq_ptr;
+	int fd, i;
+
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = 4 * URING_ENTRIES;
+	fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+	if (fd < 0) {
+		return -1;
+	}
+	ring.fd = fd;
+
+	ring.sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring.cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring.sq_len = ring.cq_len = (ring.sq_len > ring.cq_len) ? ring.sq_len : ring.cq_len;
+	}
+	sq_ptr = mmap(NULL, ring.sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sq_ptr == MAP_FAILED) {
+		uringRelease();
+		return -1;
+	}
+	ring.sq_ptr = sq_ptr;
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		cq_ptr = sq_ptr;
+	} else {
+		cq_ptr = mmap(NULL, ring.cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (cq_ptr == MAP_FAILED) {
+			uringRelease();
+			return -1;
+		}
+	}
+	ring.cq_ptr = cq_ptr;
+	ring.sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	sqes = mmap(NULL, ring.sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) {
+		uringRelease();
+		return -1;
+	}
+	ring.sqes = sqes;
+
+	ring.sq_head = (unsigned *) (sq_ptr + p.sq_off.head);
+	ring.sq_tail = (unsigned *) (sq_ptr + p.sq_off.tail);
+	ring.sq_mask = (unsigned *) (sq_ptr + p.sq_off.ring_mask);
+	ring.sq_array = (unsigned *) (sq_ptr + p.sq_off.array);
+	ring.sq_entries = p.sq_entries;
+	ring.sqe_tail = *ring.sq_tail;
+	ring.cq_head = (unsigned *) (cq_ptr + p.cq_off.head);
+	ring.cq_tail = (unsigned *) (cq_ptr + p.cq_off.tail);
+	ring.cq_mask = (unsigned *) (cq_ptr + p.cq_off.ring_mask);
+	ring.cqes = (struct io_uring_cqe *) (cq_ptr + p.cq_off.cqes);
+
+	// register ring of provided receive buffers, needs Linux 5.19
+	buf_ring = mmap(NULL, URING_BUFFERS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf_ring == MAP_FAILED) {
+		buf_ring = NULL;
+		uringRelease();
+		return -1;
+	}
+	buffers = malloc(URING_BUFFERS * URING_BUFLEN);
+	if (buffers == NULL) {
+		uringRelease();
+		return -1;
+	}
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (unsigned long) buf_ring;
+	reg.ring_entries = URING_BUFFERS;
+	reg.bgid = 0;
+	if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		uringRelease();
+		return -1;
+	}
+	buf_ring->tail = 0;
+	for (i = 0; i < URING_BUFFERS; i++) {
+		uringRecycle(i);
+	}
+
+	recv_sock = s;
+	memset(&recv_msg, 0, sizeof(recv_msg));
+	recv_msg.msg_namelen = sizeof(struct sockaddr_in);
+	uringArmRecv();
+
+	return 0;
+}
+
+/**
+ * Check if the engine is running
+ * @return int
+ */
+int uringActive(void) {
+	return ring.fd >= 0;
+}
+
+/**
+ * Write the rest of a request straight to its file
+ * @param struct uringWrite * w
+ */
+static void uringWriteSync(struct uringWrite *w) {
+	ssize_t n;
+
+	while (w->done < w->len) {
+		n = write(w->file->fd, w->data + w->done, w->len - w->done);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			syslog(LOG_ERR, "Cannot write logfile: %s", n < 0 ? strerror(errno) : "no progress");
+			return;
+		}
+		w->done += n;
+	}
+}
+
+/**
+ * Tear down ring, used when the kernel turns out not to support it
+ *
+ * Writes still queued are written straight, later ones of the open logfiles
+ * go to writev() by uringWrite().
+ */
+static void uringClose(void) {
+	struct uringFile *file, *next;
+	struct uringWrite *w;
+
+	for (file = files_open; file != NULL; file = next) {
+		next = file->next;
+		while ((w = file->head) != NULL) {
+			uringWriteSync(w);
+			file->head = w->next;
+			uringWriteRelease(w);
+			writes_pending--;
+		}
+		file->tail = NULL;
+		if (file->closing) {
+			uringFileRelease(file);
+		}
+	}
+	uringRelease();
+}
+
+/**
+ * The io_uring receiver loop, running forever, stopped by signals
+ *
+ * Returns if the kernel does not support multishot recvmsg, before any
+ * datagram was received, or if io_uring_enter() keeps failing, so the caller
+ * can fall back to the classic loop.
+ */
+void uringLoop(void) {
+	unsigned int errors = 0;
+
+	while (1) {
+		checkFlush();
+		if (uringEnter(1) < 0 && errno != EINTR) {
+			syslog(LOG_ERR, "io_uring_enter failed: %s", strerror(errno));
+			if (++errors >= URING_MAXERRORS) {
+				syslog(LOG_ERR, "io_uring keeps failing, falling back to recvfrom");
+				uringReap(1);
+				uringClose();
+				return;
+			}
+			continue;
+		}
+		errors = 0;
+		if (!uringReap(1)) {
+			syslog(LOG_INFO, "multishot recvmsg not supported, falling back to recvfrom");
+			uringClose();
+			return;
+		}
+	}
+}
+
+/**
+ * Wait until all queued logfile writes are done, datagrams still arriving
+ * are dropped
+ */
+void uringShutdown(void) {
+	if (!uringActive()) {
+		return;
+	}
+	while (writes_pending > 0) {
+		if (uringEnter(1) < 0 && errno != EINTR) {
+			break;
+		}
+		uringReap(0);
+	}
+}
+
+/**
+ * Take over an open logfile, its writes are submitted through the ring
+ * @param int fd file opened with O_APPEND, closed by uringCloseFile()
+ * @return struct uringFile *
+ */
+struct uringFile * uringOpen(int fd) {
+	struct uringFile *file = files_free;
+
+	if (file != NULL) {
+		files_free = file->next;
+		memset(file, 0, sizeof(struct uringFile));
+	} else {
+		file = calloc(1, sizeof(struct uringFile));
+		stat_mallocs++;
+	}
+	if (file != NULL) {
+		file->fd = fd;
+		file->next = files_open;
+		if (files_open != NULL) {
+			files_open->prev = file;
+		}
+		files_open = file;
+	}
+
+	return file;
+}
+
+/**
+ * Copy data into one write request of the ring
+ * @param struct uringFile * file
+ * @param const struct iovec * iov
+ * @param int iovcnt
+ * @return ssize_t bytes queued or -1
+ */
+ssize_t uringWrite(struct uringFile *file, const struct iovec *iov, int iovcnt) {
+	struct uringWrite *w;
+	size_t len = 0;
+	int i;
+
+	if (!uringActive()) {
+		return writev(file->fd, iov, iovcnt);
+	}
+	for (i = 0; i < iovcnt; i++) {
+		len += iov[i].iov_len;
+	}
+	w = uringWriteAlloc(len);
+	if (w == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	w->len = 0;
+	for (i = 0; i < iovcnt; i++) {
+		memcpy(w->data + w->len, iov[i].iov_base, iov[i].iov_len);
+		w->len += iov[i].iov_len;
+	}
+	w->done = 0;
+	w->file = file;
+	w->next = NULL;
+	writes_pending++;
+
+	if (file->tail != NULL) {
+		file->tail->next = w;
+		file->tail = w;
+	} else {
+		file->head = file->tail = w;
+		uringSubmitWrite(file);
+	}
+
+	return len;
+}
+
+/**
+ * Close logfile once its last write is done
+ * @param struct uringFile * file
+ */
+void uringCloseFile(struct uringFile *file) {
+	if (file->head == NULL) {
+		uringFileRelease(file);
+	} else {
+		file->closing = 1;
+	}
+}
+
+#ifdef	__cplusplus
+}
+#endif
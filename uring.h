@@ -0,0 +1,35 @@
+/*
+ * io_uring ingest engine header
+ *
+ * File:   uring.h
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifndef URING_H
+#define	URING_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <sys/uio.h>
+
+#define URING_ENTRIES 256
+#define URING_BUFFERS 512
+
+int uringInit(int s);
+int uringActive(void);
+void uringLoop(void);
+void uringShutdown(void);
+struct uringFile * uringOpen(int fd);
+ssize_t uringWrite(struct uringFile *file, const struct iovec *iov, int iovcnt);
+void uringCloseFile(struct uringFile *file);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* URING_H */
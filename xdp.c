@@ -0,0 +1,378 @@
+/*
+ * AF_XDP ingest engine
+ *
+ * A small XDP program attached to the interface in generic (SKB) mode
+ * redirects the UDP frames to our port into an AF_XDP socket per receive
+ * queue. The frames land in a UMEM area shared with yaul and are logged from
+ * there. All other traffic passes on to the network stack. Generic mode works
+ * on every interface, including veth and loopback.
+ *
+ * File:   xdp.c
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <syslog.h>
+
+#include "config.h"
+#include "xdp.h"
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+// provided by yaul.c
+extern unsigned int stat_batches;
+extern unsigned int stat_batch_messages;
+void handleDatagram(const char *buffer, size_t len, struct sockaddr_in *cliAddr);
+void checkFlush(void);
+
+// Mapped producer/consumer ring of the AF_XDP socket
+struct xdpRing {
+	unsigned int *producer;
+	unsigned int *consumer;
+	void *descs;
+};
+
+static int xsk_map = -1;					// XSKMAP, receive queue to socket
+static int xdp_prog = -1;					// the redirect program
+static int xdp_link = -1;					// attachment of the program
+static int xsk = -1;						// AF_XDP socket of this process
+static char *umem = NULL;					// frames shared with the kernel
+static struct xdpRing rx_ring;
+static struct xdpRing fill_ring;
+
+/**
+ * Thin wrapper of the bpf syscall
+ * @param int cmd
+ * @param union bpf_attr * attr
+ * @return int
+ */
+static int xdpBpf(int cmd, union bpf_attr *attr) {
+	return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/**
+ * Append instruction to program
+ */
+static void xdpEmit(struct bpf_insn *prog, unsigned int *n, unsigned char code,
+		unsigned char dst, unsigned char src, short off, int imm) {
+	prog[*n].code = code;
+	prog[*n].dst_reg = dst;
+	prog[*n].src_reg = src;
+	prog[*n].off = off;
+	prog[*n].imm = imm;
+	(*n)++;
+}
+
+/**
+ * Create XSKMAP, load redirect program and attach it to the interface in
+ * generic mode. Called once before the workers are forked, they inherit the
+ * descriptors.
+ * @return int 0 on success, -1 if not available
+ */
+int xdpSetup(void) {
+	struct bpf_insn prog[48];
+	unsigned int pass[8];
+	unsigned int n = 0, npass = 0, i;
+	struct in_addr addr;
+	union bpf_attr attr;
+	char log[4096];
+	unsigned int ifindex;
+
+	if (config.interface == NULL || (ifindex = if_nametoindex(config.interface)) == 0) {
+		syslog(LOG_ERR, "XDP engine needs a valid --interface");
+		return -1;
+	}
+	inet_pton(AF_INET, config.address, &addr);
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type = BPF_MAP_TYPE_XSKMAP;
+	attr.key_size = sizeof(int);
+	attr.value_size = sizeof(int);
+	attr.max_entries = MAXWORKERS;
+	xsk_map = xdpBpf(BPF_MAP_CREATE, &attr);
+	if (xsk_map < 0) {
+		return -1;
+	}
+
+	// r2 = data, r3 = data_end, pass if shorter than ethernet, IP and UDP header
+	xdpEmit(prog, &n, BPF_LDX | BPF_MEM | BPF_W, 2, 1, 0, 0);
+	xdpEmit(prog, &n, BPF_LDX | BPF_MEM | BPF_W, 3, 1, 4, 0);
+	xdpEmit(prog, &n, BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0);
+	xdpEmit(prog, &n, BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, 42);
+	pass[npass++] = n;
+	xdpEmit(prog, &n, BPF_JMP | BPF_JGT | BPF_X, 4, 3, 0, 0);
+	// IPv4 without options, UDP, not fragmented
+	xdpEmit(prog, &n, BPF_LDX | BPF_MEM | BPF_H, 5, 2, 12, 0);
+	pass[npass++] = n;
+	xdpEmit(prog, &n, BPF_JMP | BPF_JNE | BPF_K, 5, 0, 0, htons(0x0800));
+	xdpEmit(prog, &n, BPF_LDX | BPF_MEM | BPF_B, 5, 2, 14, 0);
+	pass[npass++] = n;
+	xdpEmit(prog, &n, BPF_JMP | BPF_JNE | BPF_K, 5, 0, 0, 0x45);
+	xdpEmit(prog, &n, BPF_LDX | BPF_MEM | BPF_B, 5, 2, 23, 0);
+	pass[npass++] = n;
+	xdpEmit(prog, &n, BPF_JMP | BPF_JNE | BPF_K, 5, 0, 0, IPPROTO_UDP);
+	xdpEmit(prog, &n, BPF_LDX | BPF_MEM | BPF_H, 5, 2, 20, 0);
+	xdpEmit(prog, &n, BPF_ALU64 | BPF_AND | BPF_K, 5, 0, 0, htons(0x3fff));
+	pass[npass++] = n;
+	xdpEmit(prog, &n, BPF_JMP | BPF_JNE | BPF_K, 5, 0, 0, 0);
+	// our port and address
+	xdpEmit(prog, &n, BPF_LDX | BPF_MEM | BPF_H, 5, 2, 36, 0);
+	pass[npass++] = n;
+	xdpEmit(prog, &n, BPF_JMP | BPF_JNE | BPF_K, 5, 0, 0, htons(config.port));
+	if (addr.s_addr != htonl(INADDR_ANY)) {
+		xdpEmit(prog, &n, BPF_LDX | BPF_MEM | BPF_W, 5, 2, 30, 0);
+		pass[npass++] = n;
+		xdpEmit(prog, &n, BPF_JMP32 | BPF_JNE | BPF_K, 5, 0, 0, addr.s_addr);
+	}
+	// return bpf_redirect_map(&xsk_map, ctx->rx_queue_index, XDP_PASS)
+	xdpEmit(prog, &n, BPF_LDX | BPF_MEM | BPF_W, 2, 1, 16, 0);
+	xdpEmit(prog, &n, BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, xsk_map);
+	xdpEmit(prog, &n, 0, 0, 0, 0, 0);
+	xdpEmit(prog, &n, BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS);
+	xdpEmit(prog, &n, BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map);
+	xdpEmit(prog, &n, BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+	// pass:
+	for (i = 0; i < npass; i++) {
+		prog[pass[i]].off = n - pass[i] - 1;
+	}
+	xdpEmit(prog, &n, BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_PASS);
+	xdpEmit(prog, &n, BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_XDP;
+	attr.insns = (unsigned long) prog;
+	attr.insn_cnt = n;
+	attr.license = (unsigned long) "GPL";
+	attr.log_buf = (unsigned long) log;
+	attr.log_size = sizeof(log);
+	attr.log_level = 1;
+	log[0] = '\0';
+	xdp_prog = xdpBpf(BPF_PROG_LOAD, &attr);
+	if (xdp_prog < 0) {
+		syslog(LOG_ERR, "Cannot load XDP program: %s %s", strerror(errno), log);
+		close(xsk_map);
+		return -1;
+	}
+
+	memset(&attr, 0, sizeof(attr));
+	attr.link_create.prog_fd = xdp_prog;
+	attr.link_create.target_ifindex = ifindex;
+	attr.link_create.attach_type = BPF_XDP;
+	attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+	xdp_link = xdpBpf(BPF_LINK_CREATE, &attr);
+	if (xdp_link < 0) {
+		syslog(LOG_ERR, "Cannot attach XDP program to %s: %s", config.interface, strerror(errno));
+		close(xdp_prog);
+		close(xsk_map);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Map ring of the AF_XDP socket
+ * @param struct xdpRing * ring
+ * @param struct xdp_ring_offset * off
+ * @param size_t desc_size
+ * @param off_t pgoff
+ * @return int
+ */
+static int xdpMapRing(struct xdpRing *ring, struct xdp_ring_offset *off, size_t desc_size, off_t pgoff) {
+	char *map;
+
+	map = mmap(NULL, off->desc + XDP_RINGSIZE * desc_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, xsk, pgoff);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+	ring->producer = (unsigned int *) (map + off->producer);
+	ring->consumer = (unsigned int *) (map + off->consumer);
+	ring->descs = map + off->desc;
+
+	return 0;
+}
+
+/**
+ * Open AF_XDP socket for a receive queue and register it in the XSKMAP
+ * @param unsigned int queue
+ * @return int 0 on success, -1 if not available
+ */
+int xdpInit(unsigned int queue) {
+	struct xdp_umem_reg reg;
+	struct xdp_mmap_offsets off;
+	struct sockaddr_xdp sxdp;
+	union bpf_attr attr;
+	socklen_t optlen = sizeof(off);
+	int ringsize = XDP_RINGSIZE;
+	int fd;
+	unsigned int i;
+	unsigned long long *fill;
+
+	if (xsk_map < 0) {
+		return -1;
+	}
+
+	xsk = socket(AF_XDP, SOCK_RAW, 0);
+	if (xsk < 0) {
+		return -1;
+	}
+	umem = mmap(NULL, XDP_RINGSIZE * XDP_FRAMESIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (umem == MAP_FAILED) {
+		goto fail;
+	}
+
+	memset(&reg, 0, sizeof(reg));
+	reg.addr = (unsigned long) umem;
+	reg.len = XDP_RINGSIZE * XDP_FRAMESIZE;
+	reg.chunk_size = XDP_FRAMESIZE;
+	reg.headroom = 0;
+	if (setsockopt(xsk, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0
+			|| setsockopt(xsk, SOL_XDP, XDP_UMEM_FILL_RING, &ringsize, sizeof(ringsize)) < 0
+			|| setsockopt(xsk, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ringsize, sizeof(ringsize)) < 0
+			|| setsockopt(xsk, SOL_XDP, XDP_RX_RING, &ringsize, sizeof(ringsize)) < 0
+			|| getsockopt(xsk, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0) {
+		goto fail;
+	}
+	if (xdpMapRing(&fill_ring, &off.fr, sizeof(unsigned long long), XDP_UMEM_PGOFF_FILL_RING) < 0
+			|| xdpMapRing(&rx_ring, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) < 0) {
+		goto fail;
+	}
+
+	// hand all frames to the kernel
+	fill = fill_ring.descs;
+	for (i = 0; i < XDP_RINGSIZE; i++) {
+		fill[i] = (unsigned long long) i * XDP_FRAMESIZE;
+	}
+	__atomic_store_n(fill_ring.producer, XDP_RINGSIZE, __ATOMIC_RELEASE);
+
+	memset(&sxdp, 0, sizeof(sxdp));
+	sxdp.sxdp_family = AF_XDP;
+	sxdp.sxdp_ifindex = if_nametoindex(config.interface);
+	sxdp.sxdp_queue_id = queue;
+	sxdp.sxdp_flags = XDP_COPY;
+	if (bind(xsk, (struct sockaddr *) &sxdp, sizeof(sxdp)) < 0) {
+		goto fail;
+	}
+
+	fd = xsk;
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = xsk_map;
+	attr.key = (unsigned long) &queue;
+	attr.value = (unsigned long) &fd;
+	if (xdpBpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+		goto fail;
+	}
+
+	return 0;
+
+fail:
+	syslog(LOG_ERR, "Cannot set up AF_XDP socket: %s", strerror(errno));
+	close(xsk);
+	xsk = -1;
+	return -1;
+}
+
+/**
+ * Log datagram of a received frame
+ * @param char * frame starting with the ethernet header
+ * @param unsigned int framelen
+ */
+static void xdpFrame(char *frame, unsigned int framelen) {
+	struct sockaddr_in cliAddr;
+	unsigned char *ip, *udp;
+	char *payload;
+	unsigned int len;
+
+	if (framelen < 42) {
+		return;
+	}
+	ip = (unsigned char *) frame + 14;
+	udp = ip + 20;
+	payload = (char *) udp + 8;
+	len = ((udp[4] << 8) | udp[5]) - 8;
+	if (len > framelen - 42) {
+		len = framelen - 42;
+	}
+	if (len > BUF) {
+		len = BUF;
+	}
+
+	memset(&cliAddr, 0, sizeof(cliAddr));
+	cliAddr.sin_family = AF_INET;
+	memcpy(&cliAddr.sin_addr, ip + 12, 4);
+	memcpy(&cliAddr.sin_port, udp, 2);
+
+	handleDatagram(payload, len, &cliAddr);
+}
+
+/**
+ * The AF_XDP receiver loop, running forever, stopped by signals
+ *
+ * Every received frame goes straight back to the fill ring once logged.
+ */
+void xdpLoop(void) {
+	struct xdp_desc *descs = rx_ring.descs;
+	unsigned long long *fill = fill_ring.descs;
+	unsigned int prod, cons, fprod, n, i;
+	unsigned long long addr;
+	struct pollfd pfd;
+
+	pfd.fd = xsk;
+	pfd.events = POLLIN;
+
+	while (1) {
+		checkFlush();
+		prod = __atomic_load_n(rx_ring.producer, __ATOMIC_ACQUIRE);
+		cons = *rx_ring.consumer;
+		n = prod - cons;
+		if (n == 0) {
+			poll(&pfd, 1, -1);
+			continue;
+		}
+
+		fprod = *fill_ring.producer;
+		for (i = 0; i < n; i++) {
+			addr = descs[(cons + i) & (XDP_RINGSIZE - 1)].addr;
+			xdpFrame(umem + addr, descs[(cons + i) & (XDP_RINGSIZE - 1)].len);
+			fill[(fprod + i) & (XDP_RINGSIZE - 1)] = addr - addr % XDP_FRAMESIZE;
+		}
+		__atomic_store_n(rx_ring.consumer, cons + n, __ATOMIC_RELEASE);
+		__atomic_store_n(fill_ring.producer, fprod + n, __ATOMIC_RELEASE);
+
+		stat_batches++;
+		stat_batch_messages += n;
+	}
+}
+
+#ifdef	__cplusplus
+}
+#endif
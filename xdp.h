@@ -0,0 +1,29 @@
+/*
+ * AF_XDP ingest engine header
+ *
+ * File:   xdp.h
+ * Author: Andreas Behringer
+ *
+ * (c)2012 Andreas Behringer
+ * Copyright: GPL see included LICENSE file
+ */
+
+#ifndef XDP_H
+#define	XDP_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define XDP_FRAMESIZE 2048
+#define XDP_RINGSIZE 2048				// also number of frames in the UMEM
+
+int xdpSetup(void);
+int xdpInit(unsigned int queue);
+void xdpLoop(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* XDP_H */
@@ -10,33 +10,67 @@
  * Created on November 19, 2012, 1:06 PM
  */
 
+#define _GNU_SOURCE
+
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <sys/time.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <stdio.h>
+#include <stdio_ext.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <errno.h>
 #include <time.h>
 #include <signal.h>
 #include <syslog.h>
+#include <pthread.h>
 
 #include "hiredis/hiredis.h"
-#include "hashtable/hashtable.h"
-#include "hashtable/hashtable_itr.h"
 
 #include "config.h"
+#include "timestamp.h"
+#include "queue.h"
 #include "yaul.h"
 #include "hash.h"
+#include "intern.h"
+#include "uring.h"
+#include "packet.h"
+#include "xdp.h"
+#include "parser.h"
+#include "address.h"
+#include "pool.h"
+#include "redissink.h"
+#include "steer.h"
 
 // general vars
 struct handlebuffer * lastfile = NULL;		// last used file in handlebuffer
-struct hashtable *handles;					// hashtable for buffering open filetables
-redisContext *redis_context = NULL;			// context of opened redis connection
+struct handlebuffer * lru_newest = NULL;	// most recently used open file
+struct handlebuffer * lru_oldest = NULL;	// least recently used open file, evicted first
+handlebuffer **handles = NULL;				// open logfiles by logname id
+unsigned int handles_open = 0;				// number of open logfiles
+handlebuffer *handles_free = NULL;			// closed records with their buffers, for reuse
+rediskey *rediskeys = NULL;					// redis list keys by logname id
 int sock = 0;								// the UDP socket
+int *socks = NULL;							// one UDP socket per receive thread of every worker
+unsigned int nsocks = 0;					// sockets in the SO_REUSEPORT group
+pid_t *workers = NULL;						// pids of forked workers
+unsigned int worker_id = 0;					// index of this worker process
+volatile sig_atomic_t terminating = 0;		// supervisor is shutting down
+volatile sig_atomic_t reopening = 0;		// SIGHUP, close logfiles before next write
+volatile sig_atomic_t flushing = 0;			// flush timer expired
+volatile sig_atomic_t stopping = 0;			// SIGINT/SIGTERM, shut down outside the handler
+int writer = 0;								// a writer thread logs queued datagrams
+spscRing *queue = NULL;						// datagrams from the receive thread
+mpscRing *mqueue = NULL;					// datagrams from several receive threads
+int pooled = 0;								// logfiles are written by the writer pool
 struct yaulConfig config;					// Configuration variable holder declaration
 
 // statistic vars hold information since server start
@@ -44,67 +78,152 @@ unsigned int stat_messages_handled = 0;		// messages handled and stored
 unsigned int stat_files_opened = 0;			// files opened
 unsigned int stat_files_closed = 0;			// files closed
 unsigned int stat_files_switched = 0;		// number of logfile switches
+unsigned int stat_handle_hits = 0;			// logfile found open in handle cache
+unsigned int stat_handle_misses = 0;		// logfile not open, had to be opened
+unsigned int stat_handle_evictions = 0;		// logfiles closed to make room
+unsigned int stat_batches = 0;				// receive syscalls returning data
+unsigned int stat_batch_messages = 0;		// datagrams returned by those syscalls
+unsigned int stat_address_hits = 0;			// sender found in address cache
+unsigned int stat_address_misses = 0;		// sender formatted into address cache
+unsigned int stat_writes = 0;				// write syscalls to logfiles
+unsigned long stat_write_bytes = 0;			// bytes written by those syscalls
+unsigned int stat_mallocs = 0;				// allocations on the message path
+unsigned int stat_queue_drains = 0;			// batches taken from the queue by the writer
+unsigned int stat_queue_drained = 0;		// slots in those batches
+unsigned int stat_redis_flushes = 0;		// pipelines of redis commands sent
+unsigned int stat_redis_commands = 0;		// redis commands in those pipelines
+unsigned int stat_redis_drops = 0;			// redis commands dropped, no connection or window full
+unsigned int stat_redis_lost = 0;			// redis commands sent whose connection was lost
+unsigned int stat_redis_reconnects = 0;		// redis connection attempts
+unsigned int stat_redis_pushes = 0;			// LPUSH commands sent to redis
+unsigned long stat_redis_values = 0;		// lines in those commands
 time_t stat_start_time = 0;					// timestamp server was started
 
 /**
- * Compare function for hashtable key comparison
- * @param void * a
- * @param void * b
- * @return bool
+ * Dump open logfiles to stderr, newest first, for debugging purposes
  */
-static int cmpKeys(void *a, void *b) {
-	return (0 == strcmp(a, b));
+void handlesDump(void) {
+	struct handlebuffer * handle;
+	
+	unsigned int id;
+	
+	fprintf(stderr, "\nBegin dump\n");
+	for (handle = lru_newest; handle != NULL; handle = handle->older) {
+		fprintf(stderr, "Key %s: Id %u Used %zu\n", interned[handle->id].name, handle->id, handle->used);
+	}
+	for (id = 0; id < internCount(); id++) {
+		fprintf(stderr, "Logname %s: Id %u Hash %08x Messages %lu\n", interned[id].name, id, interned[id].hash, interned[id].messages);
+	}
 }
 
 /**
- * Dump hashtable to stderr, for debugging purposes
- * @param h
+ * Remove open file from LRU list
+ * @param handlebuffer * handle
  */
-void hashtableDump(struct hashtable *h) {
-	struct hashtable_itr *itr;
-	struct handlebuffer * handle;
-	char * key;
-	
-	if (hashtable_count(h) > 0) {
-		itr = hashtable_iterator(h);
-		fprintf(stderr, "\nBegin dump\n");
+static inline void lruUnlink(handlebuffer *handle) {
+	if (handle->newer != NULL) {
+		handle->newer->older = handle->older;
+	} else {
+		lru_newest = handle->older;
+	}
+	if (handle->older != NULL) {
+		handle->older->newer = handle->newer;
+	} else {
+		lru_oldest = handle->newer;
+	}
+}
 
-		do {
-			handle = hashtable_iterator_value(itr);
-			key = hashtable_iterator_key(itr);
-			fprintf(stderr, "Key %s: Filename %s\n", key, handle->name);
-		} while (hashtable_iterator_advance(itr));
+/**
+ * Insert open file as most recently used into LRU list
+ * @param handlebuffer * handle
+ */
+static inline void lruPush(handlebuffer *handle) {
+	handle->newer = NULL;
+	handle->older = lru_newest;
+	if (lru_newest != NULL) {
+		lru_newest->newer = handle;
+	} else {
+		lru_oldest = handle;
+	}
+	lru_newest = handle;
+}
+
+/**
+ * Preallocate records of maxhandles logfiles, their append buffers are
+ * allocated on first use and stay with the record
+ */
+void initHandlePool(void) {
+	handlebuffer *pool;
+	unsigned int i;
+	
+	pool = calloc(config.maxhandles, sizeof(handlebuffer));
+	if (pool == NULL) {
+		perror("Cannot allocate logfile handles");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < config.maxhandles; i++) {
+		pool[i].older = handles_free;
+		handles_free = &pool[i];
+	}
+}
 
-		free(itr);
+/**
+ * Take record from free list, with its buffer once it had one
+ * 
+ * More records than maxhandles are only needed while the newest file is
+ * kept open beyond the limit, they join the free list later as well.
+ * @return handlebuffer * or NULL if out of memory
+ */
+static handlebuffer * handleAlloc(void) {
+	handlebuffer *handle = handles_free;
+	
+	if (handle != NULL) {
+		handles_free = handle->older;
+	} else {
+		handle = calloc(1, sizeof(handlebuffer));
+		stat_mallocs++;
+		if (handle == NULL) {
+			return NULL;
+		}
+	}
+	if (handle->buffer == NULL) {
+		handle->buffer = malloc(config.buffer_size);
+		stat_mallocs++;
+		if (handle->buffer == NULL) {
+			handleFree(handle);
+			return NULL;
+		}
 	}
+	handle->used = 0;
+	handle->ring = NULL;
+	
+	return handle;
+}
+
+/**
+ * Put record back on the free list, keeping its buffer
+ * @param handlebuffer * handle
+ */
+static void handleFree(handlebuffer *handle) {
+	handle->older = handles_free;
+	handles_free = handle;
 }
 
 /**
- * close a random filehandle entry in the handlebuffer
+ * close the least recently used filehandle entry in the handlebuffer
  */
-void closeRandomFile(void) {
-	struct hashtable_itr *itr = NULL;
+void closeLeastRecentFile(void) {
 	struct handlebuffer * handle = NULL;
-	unsigned int i = 0;
-	unsigned int r = 0;
 	
 	if (!config.opt_redis) {
-		// only run if more than one opened file
-		if (hashtable_count(handles) > 1) {
-			// do not close actual used file
-			do {
-				itr = hashtable_iterator(handles);
-				r = rand() % (hashtable_count(handles));
-				for (i = 0; i < r; i++) {
-					hashtable_iterator_advance(itr);
-				}
-				handle = hashtable_iterator_value(itr);
-				free(itr);
-			} while (strcmp(handle->name, lastfile->name) == 0);
-			
-			fclose(handle->filehandle);
-			stat_files_closed++;
-			hashtable_remove(handles, handle->name);
+		// only run if more than one opened file, the newest is the actual used
+		if (handles_open > 1) {
+			handle = lru_oldest;
+			lruUnlink(handle);
+			handles[handle->id] = NULL;
+			handles_open--;
+			closeLogfile(handle);
+			stat_handle_evictions++;
 		}
 	}
 }
@@ -113,20 +232,33 @@ void closeRandomFile(void) {
  * Close all opened filehandles in cache
  */
 void closeAllFiles(void) {
-	struct hashtable_itr *itr;
 	struct handlebuffer * handle;
 	
-	itr = hashtable_iterator(handles);
-	if (!config.opt_redis) {
-		if (hashtable_count(handles) > 0) {
-			do {
-				handle = hashtable_iterator_value(itr);
-				fclose(handle->filehandle);
-				stat_files_closed++;
-			} while (hashtable_iterator_remove(itr));			
-		}
+	while (lru_newest != NULL) {
+		handle = lru_newest;
+		lruUnlink(handle);
+		handles[handle->id] = NULL;
+		handles_open--;
+		closeLogfile(handle);
+	}
+	lastfile = NULL;
+}
+
+/**
+ * Drop all state kept per logname id and start interning from scratch,
+ * used once more lognames showed up than there are ids
+ */
+void resetLognames(void) {
+	closeAllFiles();
+	if (rediskeys != NULL) {
+		memset(rediskeys, 0, config.maxnames * sizeof(rediskey));
+	}
+	if (pooled) {
+		// the ids of the lognames pick their lanes, let the old ones finish
+		poolDrain();
 	}
-	free(itr);
+	internReset();
+	syslog(LOG_INFO, "more than %u lognames, forgot all of them", config.maxnames);
 }
 
 /**
@@ -135,7 +267,14 @@ void closeAllFiles(void) {
 void shutdownServer(void) {
 	syslog(LOG_INFO, "exiting");
 	closeAllFiles();
-	hashtable_destroy(handles, 1);
+	if (config.opt_redis) {
+		redisSinkDrain(REDIS_DRAIN_MS);
+	}
+	if (pooled) {
+		poolDrain();
+	}
+	uringShutdown();
+	free(handles);
     closelog();
     exit(EXIT_SUCCESS);
 }
@@ -146,7 +285,8 @@ void shutdownServer(void) {
  */
 static void sig_hup(int signo) {
     syslog(LOG_INFO, "caught SIGHUP");
-	closeAllFiles();
+	// files are closed by openLogfile(), not in the middle of a write
+	reopening = 1;
 }
 
 /**
@@ -155,7 +295,8 @@ static void sig_hup(int signo) {
  */
 static void sig_int(int signo) {
     syslog(LOG_INFO, "caught SIGINT");
-    shutdownServer();
+	// shut down by the writer thread or the receive loop, see checkFlush()
+	stopping = 1;
 }
 
 /**
@@ -164,7 +305,31 @@ static void sig_int(int signo) {
  */
 static void sig_term(int signo) {
     syslog(LOG_INFO, "caught SIGTERM");
-    shutdownServer();
+	stopping = 1;
+}
+
+/**
+ * Install handler for a signal that stops the server, without SA_RESTART so
+ * it also wakes up the receive loop blocking in a syscall
+ * @param int signo
+ * @param void (*handler)(int)
+ * @return int 0 on success, -1 on error
+ */
+static int setStopHandler(int signo, void (*handler)(int)) {
+	struct sigaction sa;
+	
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handler;
+	sigemptyset(&sa.sa_mask);
+	return sigaction(signo, &sa, NULL);
+}
+
+/**
+ * Signal handler for SIGALRM of the flush timer
+ * @param int signo
+ */
+static void sig_alarm(int signo) {
+	flushing = 1;
 }
 
 
@@ -210,10 +375,10 @@ void daemonize_server(void) {
     if(signal(SIGHUP, sig_hup) == SIG_ERR) {
         exit(EXIT_FAILURE);
     }
-    if(signal(SIGINT, sig_int) == SIG_ERR) {
+    if(setStopHandler(SIGINT, sig_int) < 0) {
         exit(EXIT_FAILURE);
     }
-    if(signal(SIGTERM, sig_term) == SIG_ERR) {
+    if(setStopHandler(SIGTERM, sig_term) < 0) {
         exit(EXIT_FAILURE);
     }
     
@@ -222,31 +387,20 @@ void daemonize_server(void) {
 }
 
 /**
- * Open connection to Redis server
+ * Open UDP socket and bind it to address and port
  * 
- * Errors are handled outside to keep server running if connection fails
- */
-void openRedis(void) {
-	struct timeval redis_timeout = { 1, 500000 }; // 1.5 seconds
-	
-	redis_context = redisConnectWithTimeout(config.redis_ip, config.redis_port, redis_timeout);
-	if (redis_context->err) {
-		syslog(LOG_ERR, "Redis connection error: %s\n", redis_context->errstr);
-    }	
-}
-
-/**
- * Init server, open socket and syslog, bind socket to address and port
+ * With more than one worker every worker gets its own socket in the same
+ * SO_REUSEPORT group and the kernel spreads datagrams between them.
+ * @return int
  */
-void initServer(void) {
+int openSocket(void) {
 	struct sockaddr_in servAddr;
 	const int y = 1;
 	int rc;
+	int s;
 	
-	handles = create_hashtable(config.maxhandles, djb2Hash, cmpKeys);
-	
-	sock = socket (AF_INET, SOCK_DGRAM, 0);
-	if (sock < 0) {
+	s = socket (AF_INET, SOCK_DGRAM, 0);
+	if (s < 0) {
 		perror("Cannot open socket\n");
 		exit (EXIT_FAILURE);
 	}
@@ -257,23 +411,83 @@ void initServer(void) {
 	}
 	servAddr.sin_family = AF_INET;
 	servAddr.sin_port = htons (config.port);
-	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &y, sizeof(int));
-	rc = bind (sock, (struct sockaddr *) &servAddr, sizeof (servAddr));
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &y, sizeof(int));
+	if (nsocks > 1 && setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &y, sizeof(int)) < 0) {
+		perror("Cannot set SO_REUSEPORT");
+		exit (EXIT_FAILURE);
+	}
+	rc = bind (s, (struct sockaddr *) &servAddr, sizeof (servAddr));
 	if (rc < 0) {
 		fprintf (stderr, "cannot bind port %d\n", config.port);
 		exit (EXIT_FAILURE);
 	}
+	
+	return s;
+}
+
+/**
+ * Attach the logname steering program to the SO_REUSEPORT group, so every
+ * logfile is written by exactly one worker, see steer.c
+ */
+void attachSteering(void) {
+	if (steerAttach(socks[0], nsocks) < 0) {
+		perror("Cannot attach logname steering program");
+		exit (EXIT_FAILURE);
+	}
+}
+
+/**
+ * Init server, open sockets and syslog, bind sockets to address and port
+ */
+void initServer(void) {
+	unsigned int i;
+	
+	internInit(config.maxnames);
+	initHandlePool();
+	handles = calloc(config.maxnames, sizeof(handlebuffer *));
+	if (config.opt_redis) {
+		rediskeys = calloc(config.maxnames, sizeof(rediskey));
+	}
+	if (handles == NULL || (config.opt_redis && rediskeys == NULL)) {
+		perror("Cannot allocate logname tables");
+		exit(EXIT_FAILURE);
+	}
+	
+	nsocks = config.opt_workers * config.opt_receivers;
+	socks = calloc(nsocks, sizeof(int));
+	workers = calloc(config.opt_workers, sizeof(pid_t));
+	for (i = 0; i < nsocks; i++) {
+		socks[i] = openSocket();
+	}
+	sock = socks[0];
+	
+	if (nsocks > 1 && config.opt_steering) {
+		attachSteering();
+	}
+	
+	// the XDP program is shared by all workers, one receive queue each
+	if (config.opt_engine == ENGINE_XDP && xdpSetup() < 0) {
+		fprintf(stderr, "XDP not available, falling back to recvfrom\n");
+		config.opt_engine = ENGINE_SOCKET;
+	}
 
 	printf ("YAUL listening on %s:%u (UDP)\n", config.address, config.port);
 	
+	if (config.opt_workers > 1) {
+		printf ("Starting %u workers%s\n", config.opt_workers, config.opt_steering ? " with logname affinity" : "");
+	}
+	
+	if (config.opt_receivers > 1) {
+		printf ("Receiving with %u threads per worker\n", config.opt_receivers);
+	}
+	
 	if (config.opt_statistics > 0) {
 		printf ("Statistics enabled to yaul.stat every %u message\n", config.opt_statistics);
 	}
 	
 	if (config.opt_redis) {
-		openRedis();
-		if (redis_context->err) {
-			fprintf(stderr, "Redis connection error: %s\n", redis_context->errstr);
+		redisSinkInit(config.maxnames);
+		if (redisSinkCheck() < 0) {
 			exit (EXIT_FAILURE);
 		} else {
 			printf("Logging to Redis enabled\n");
@@ -289,77 +503,228 @@ void initServer(void) {
 }
 
 
+/**
+ * Write all parts to a file, continues after short writes and interrupts
+ * @param int fd
+ * @param const struct iovec * iov
+ * @param int iovcnt
+ * @return ssize_t bytes written or -1 on error
+ */
+ssize_t writeFull(int fd, const struct iovec *iov, int iovcnt) {
+	struct iovec part;
+	ssize_t len, total = 0;
+
+	while (iovcnt > 0) {
+		len = writev(fd, iov, iovcnt);
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		total += len;
+		// skip the parts written completely
+		while (iovcnt > 0 && (size_t) len >= iov->iov_len) {
+			len -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (len > 0) {
+			// rest of the part written partly
+			part.iov_base = (char *) iov->iov_base + len;
+			part.iov_len = iov->iov_len - len;
+			len = writeFull(fd, &part, 1);
+			if (len < 0) {
+				return -1;
+			}
+			total += len;
+			iov++;
+			iovcnt--;
+		}
+	}
+
+	return total;
+}
+
+/**
+ * Write lines to logfile, straight, through io_uring or the writer pool
+ * @param handlebuffer * handle
+ * @param const struct iovec * iov
+ * @param int iovcnt
+ */
+void writeLogfile(handlebuffer *handle, const struct iovec *iov, int iovcnt) {
+	ssize_t len;
+	
+	if (pooled) {
+		// counted by the pool thread that writes it
+		poolWrite(handle->id, handle->fd, iov, iovcnt);
+		return;
+	}
+	if (handle->ring != NULL) {
+		len = uringWrite(handle->ring, iov, iovcnt);
+	} else {
+		len = writeFull(handle->fd, iov, iovcnt);
+	}
+	if (len < 0) {
+		syslog(LOG_ERR, "Cannot write logfile %s: %s", interned[handle->id].name, strerror(errno));
+	} else {
+		stat_writes++;
+		stat_write_bytes += len;
+	}
+}
+
+/**
+ * Write buffered lines of logfile
+ * @param handlebuffer * handle
+ */
+void flushLogfile(handlebuffer *handle) {
+	struct iovec iov;
+	
+	if (handle->used > 0) {
+		iov.iov_base = handle->buffer;
+		iov.iov_len = handle->used;
+		writeLogfile(handle, &iov, 1);
+		handle->used = 0;
+	}
+}
+
+/**
+ * Flush and close logfile and free its handle
+ * @param handlebuffer * handle
+ */
+void closeLogfile(handlebuffer *handle) {
+	flushLogfile(handle);
+	if (pooled) {
+		poolClose(handle->id, handle->fd);
+	} else if (handle->ring != NULL) {
+		uringCloseFile(handle->ring);
+	} else {
+		close(handle->fd);
+	}
+	handleFree(handle);
+	stat_files_closed++;
+}
+
 /**
  * Open logfile or return filehandle if file allready opened and in handles
- * @param char * name
- * @return FILE *
+ * @param unsigned int id Logname id
+ * @return handlebuffer *
  */
-FILE * openLogfile(char *name) {
+handlebuffer * openLogfile(unsigned int id) {
 	char filename[PATHLENGTH];
 	struct handlebuffer * newfile = NULL;
 	
+	// logrotate asked to reopen all files
+	if (reopening) {
+		reopening = 0;
+		closeAllFiles();
+	}
+	
 	// If last message has same logname just return filehandle
-	if (lastfile == NULL || strcmp(lastfile->name, name) != 0) {
-		// implicit flush stream buffer of last logfile used if flushing is set > 1
-		if (lastfile != NULL && config.opt_flush > 1 && lastfile->filehandle != NULL) {
-			fflush(lastfile->filehandle);
+	if (lastfile == NULL || lastfile->id != id) {
+		// implicit flush buffer of last logfile used if flushing is set > 1
+		if (lastfile != NULL && config.opt_flush > 1) {
+			flushLogfile(lastfile);
 		}
 		
-		// if not search linear in handles array
-		newfile = hashtable_search(handles, name);		
+		// if not look up open file of the logname
+		newfile = handles[id];
 		
 		// if not found logname in handles array open file
 		if (!newfile) {
+			stat_handle_misses++;
 			// check if max handles reached
-			if (hashtable_count(handles) >= config.maxhandles) {
-				closeRandomFile();
+			if (handles_open >= config.maxhandles) {
+				closeLeastRecentFile();
 			}
 			// open file and store in handles
-			newfile = malloc(sizeof (struct handlebuffer));
-			sprintf(filename, "%s/%s.log", config.logpath, name);
-			newfile->filehandle = fopen(filename, "a");
-			if (newfile->filehandle) {
-				strcpy(newfile->name, name);
-				hashtable_insert(handles, newfile->name, newfile);
+			newfile = handleAlloc();
+			if (newfile == NULL) {
+				return NULL;
+			}
+			sprintf(filename, "%s/%s.log", config.logpath, interned[id].name);
+			newfile->fd = open(filename, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+			// the ring belongs to the receive thread
+			if (newfile->fd >= 0 && uringActive() && !writer && !pooled) {
+				newfile->ring = uringOpen(newfile->fd);
+				if (newfile->ring == NULL) {
+					close(newfile->fd);
+					newfile->fd = -1;
+				}
+			}
+			if (newfile->fd >= 0) {
+				newfile->id = id;
+				handles[id] = newfile;
+				handles_open++;
+				lruPush(newfile);
 				stat_files_opened++;
 				stat_files_switched++;
 			} else {
-				free(newfile);
-				free(lastfile);
+				handleFree(newfile);
+				newfile = NULL;
 			}
 		} else {
+			stat_handle_hits++;
+			lruUnlink(newfile);
+			lruPush(newfile);
 			stat_files_switched++;
 		}
 		
 		lastfile = newfile;
+	} else {
+		stat_handle_hits++;
 	}
 
-	return lastfile->filehandle;
+	return lastfile;
 }
 
 /**
  * Log message to file
  * 
- * @param char * name Name of logfile
- * @param char * message Message to be logged
- * @param char * loctime Timestring to prepend
- * @param char * address IP address of client
- * @param unsigned int port Port of client
- */
-inline void logMessageFile(char *name, char *message) {
-	FILE * fp = NULL;
-	
-	fp = openLogfile(name);
-	if(fp != NULL) {
-		fprintf(fp, "%s\n", message);
+ * The line is copied straight from the receive buffer into the append buffer
+ * of the logfile, which only ever holds whole lines. So every write appends
+ * whole lines and does not interleave with other workers writing the file.
+ * @param unsigned int id Logname id
+ * @param logline * line Line to be logged
+ */
+inline void logMessageFile(unsigned int id, logline *line) {
+	handlebuffer * handle = NULL;
+	struct iovec iov[3];
+	size_t len;
+	char *p;
+	
+	handle = openLogfile(id);
+	if(handle != NULL) {
+		len = line->prefixlen + line->bodylen + 1;
+		if (handle->used + len > config.buffer_size) {
+			flushLogfile(handle);
+		}
+		if (len > config.buffer_size) {
+			// line larger than the whole buffer, write it from its parts
+			iov[0].iov_base = (void *) line->prefix;
+			iov[0].iov_len = line->prefixlen;
+			iov[1].iov_base = (void *) line->body;
+			iov[1].iov_len = line->bodylen;
+			iov[2].iov_base = "\n";
+			iov[2].iov_len = 1;
+			writeLogfile(handle, iov, 3);
+		} else {
+			p = handle->buffer + handle->used;
+			memcpy(p, line->prefix, line->prefixlen);
+			memcpy(p + line->prefixlen, line->body, line->bodylen);
+			p[len - 1] = '\n';
+			handle->used += len;
+		}
 		stat_messages_handled++;
 		// flush buffer immediately to allow tail -f on logfiles
-		if (stat_messages_handled % config.opt_flush == 0) {
-			fflush(fp);
+		if (config.opt_flush > 0 && stat_messages_handled % config.opt_flush == 0) {
+			flushLogfile(handle);
+		} else if (config.flush_bytes > 0 && handle->used >= config.flush_bytes) {
+			flushLogfile(handle);
 		}
 	} else {
 		perror("Cannot open logfile");
-		syslog(LOG_ERR, "Cannot open logfile: %s\n", name);
+		syslog(LOG_ERR, "Cannot open logfile: %s\n", interned[id].name);
 		exit(EXIT_FAILURE);
 	}
 }
@@ -367,71 +732,88 @@ inline void logMessageFile(char *name, char *message) {
 /**
  * Log message to Redis
  * 
- * @param char * name Name of log
- * @param char * message Message to be logged
- * @param char * loctime Timestring to prepend
- * @param char * address IP address of client
- * @param unsigned int port Port of client
- */
-inline void logMessageRedis(char *name, char *message) {
-	redisReply *reply;
-	char logtime[BUF];
-	time_t rawtime;
-	struct tm * timeinfo;
-	
-	time(&rawtime);
-	timeinfo = localtime(&rawtime);
-	strftime(logtime, BUF, "%Y-%m-%d", timeinfo);
-	
-	// Write logline to redis list
-    reply = redisCommand(redis_context, "LPUSH %s.%s %s", name, logtime, message);
-	stat_messages_handled++;
-	if (reply != NULL) {
-		freeReplyObject(reply);
-		if (config.redis_ttl > 0) {
-			reply = redisCommand(redis_context, "EXPIRE %s.%s %u", name, logtime, config.redis_ttl);
-			freeReplyObject(reply);
-		}
-		// @todo catch redis reply for ttl error
-	} else {
-		syslog(LOG_ERR, "Logging to redis failed at server %s:%u", config.redis_ip, config.redis_port);
-		openRedis();
+ * The line goes to the Redis sink, which pushes the lines of a list with one
+ * LPUSH, pipelines the commands and never waits for Redis. Without
+ * connection or with a full window the line is dropped.
+ * @param unsigned int id Logname id
+ * @param logline * line Line to be logged
+ */
+inline void logMessageRedis(unsigned int id, logline *line) {
+	rediskey *key = &rediskeys[id];
+	struct iovec value[2];
+	const char *logtime;
+	long long expireat;
+	
+	// day of the timestamp in line->prefix
+	logtime = timestampDate();
+	
+	// list key "<logname>.<day>" is only rebuilt when the day changes
+	if (key->len == 0 || memcmp(key->key + key->len - (DATE_LENGTH - 1), logtime, DATE_LENGTH - 1) != 0) {
+		key->len = sprintf(key->key, "%s.%s", interned[id].name, logtime);
+		key->expiring = 0;
+	}
+	
+	// the list expires TTL after the end of its day, no message adds to it later
+	expireat = 0;
+	if (config.redis_ttl > 0 && key->expiring != redisSinkConnection()) {
+		expireat = (long long) timestampDayEnd() + config.redis_ttl;
 	}
+	
+	// Write logline to redis list, both parts form one binary safe value
+	value[0].iov_base = (void *) line->prefix;
+	value[0].iov_len = line->prefixlen;
+	value[1].iov_base = (void *) line->body;
+	value[1].iov_len = line->bodylen;
+	if (redisSinkPush(id, key->key, key->len, value, 2, expireat) == 0 && expireat > 0) {
+		key->expiring = redisSinkConnection();
+	}
+	stat_messages_handled++;
 }
 
 /**
  * Log message from UDP socket depending on destination
  * 
- * @param char * buffer
- * @param char * address
- * @param unsigned int port
+ * @param const char * buffer Message, not NUL terminated
+ * @param size_t len Length of message
+ * @param const char * source Sender as "[ip:port]"
+ * @param size_t sourcelen
+ * @param const struct timespec * received Arrival from timestampClock()
  */
-inline void logMessage(char *buffer, char *address, unsigned int port) {
-	char loctime[BUF];
-	char message[MAXLENGTH];
-	time_t rawtime;
-	struct tm * timeinfo;
-	char name[NAMELENGTH];
+inline void logMessage(const char *buffer, size_t len, const char *source, size_t sourcelen, const struct timespec *received) {
+	char prefix[TIMESTAMP_LENGTH + ADDRESS_LENGTH + 2];
+	const char *timestamp;
+	size_t timestamplen;
+	parsedMessage msg;
+	logline line;
+	unsigned int id;
 	
-	// prepare timestamp
-	time(&rawtime);
-	timeinfo = localtime(&rawtime);
-	strftime(loctime, BUF, "%Y-%m-%d %H:%M:%S", timeinfo);
-	
-	// Scan for name of logfile / logname
-	if (sscanf(buffer, "[%[a-zA-Z0-9.]]%[^\n]", name, buffer) != 2) {
-		strcpy(name, "yaul");
+	// Scan for name of logfile / logname, all further work is done by its id
+	parseMessage(buffer, len, &msg);
+	id = internName(msg.name, msg.namelen, msg.hash);
+	if (id == INTERN_FULL) {
+		resetLognames();
+		id = internName(msg.name, msg.namelen, msg.hash);
 	}
+	interned[id].messages++;
+	line.body = msg.body;
+	line.bodylen = msg.bodylen;
 	
-	// build standard logline
-	sprintf(message, "%s [%s:%u] %s", loctime, address, port, buffer);
+	// build standard logline prefix "<timestamp> [ip:port] " from cached
+	// fragments, the body stays in the receive buffer
+	timestamp = timestampFormat(received, &timestamplen);
+	memcpy(prefix, timestamp, timestamplen);
+	prefix[timestamplen] = ' ';
+	memcpy(prefix + timestamplen + 1, source, sourcelen);
+	prefix[timestamplen + 1 + sourcelen] = ' ';
+	line.prefix = prefix;
+	line.prefixlen = timestamplen + sourcelen + 2;
 	
 	if (config.opt_redis) {
 		// output message to Redis
-		logMessageRedis(name, message);
+		logMessageRedis(id, &line);
 	} else {
 		// output message to file
-		logMessageFile(name, message);
+		logMessageFile(id, &line);
 	}
 }
 
@@ -440,15 +822,393 @@ inline void logMessage(char *buffer, char *address, unsigned int port) {
  */
 void statistics(void) {
 	char statistic_message[BUF];
+	char source[ADDRESS_LENGTH];
+	struct timespec now;
 	
-	sprintf(statistic_message, "[yaul.stat]messages:%u opened:%u closed:%u switched:%u running:%lu sec average/s:%f2\n",
+	sprintf(statistic_message, "[yaul.stat]worker:%u messages:%u opened:%u closed:%u switched:%u batches:%u fill:%.2f addrhits:%u addrmisses:%u writes:%u bytes/write:%.1f mallocs:%u handlehits:%u handlemisses:%u evictions:%u lognames:%u queue:%u queuemax:%u queuefull:%u queueretries:%u drain:%.1f pipeline:%.1f values/push:%.1f redisinflight:%u redisdrops:%u redislost:%u reconnects:%u laneruns:%u lanesteals:%u running:%lu sec average/s:%f2\n",
+			worker_id,
 			stat_messages_handled,
 			stat_files_opened,
 			stat_files_closed,
 			stat_files_switched,
+			stat_batches,
+			stat_batches ? (double) stat_batch_messages / stat_batches : 0.0,
+			stat_address_hits,
+			stat_address_misses,
+			stat_writes,
+			stat_writes ? (double) stat_write_bytes / stat_writes : 0.0,
+			stat_mallocs,
+			stat_handle_hits,
+			stat_handle_misses,
+			stat_handle_evictions,
+			internCount(),
+			writer ? writerDepth() : 0,
+			queue ? queue->highWater : (mqueue ? mqueue->highWater : 0),
+			queue ? queue->fullWaits : (mqueue ? mqueue->fullWaits : 0),
+			mqueue ? mqueue->claimRetries : 0,
+			stat_queue_drains ? (double) stat_queue_drained / stat_queue_drains : 0.0,
+			stat_redis_flushes ? (double) stat_redis_commands / stat_redis_flushes : 0.0,
+			stat_redis_pushes ? (double) stat_redis_values / stat_redis_pushes : 0.0,
+			config.opt_redis ? redisSinkInflight() : 0,
+			stat_redis_drops,
+			stat_redis_lost,
+			stat_redis_reconnects,
+			pooled ? poolRuns() : 0,
+			pooled ? poolSteals() : 0,
 			(unsigned int) time(NULL) - stat_start_time,
 			(double) stat_messages_handled / (time(NULL) - stat_start_time));
-	logMessage(statistic_message, config.address, config.port);
+	snprintf(source, ADDRESS_LENGTH, "[%s:%u]", config.address, config.port);
+	timestampClock(&now);
+	logMessage(statistic_message, strlen(statistic_message), source, strlen(source), &now);
+}
+
+/**
+ * Log statistics if optional statistics logging is set, every n'th message
+ */
+static inline void checkStatistics(void) {
+	if (config.opt_statistics > 0 && stat_messages_handled % config.opt_statistics == 0) {
+		statistics();
+	}
+}
+
+/**
+ * Start timer driving the time based flushing of logfiles, or of the
+ * pipelined commands in Redis mode
+ * 
+ * SIGALRM is installed without SA_RESTART, so it also wakes up the receive
+ * loops blocking in recvfrom(), poll() or io_uring_enter() while idle.
+ */
+void startFlushTimer(void) {
+	struct sigaction sa;
+	struct itimerval timer;
+	unsigned int interval;
+	
+	interval = config.opt_redis ? config.redis_latency : config.flush_interval;
+	if (interval == 0) {
+		return;
+	}
+	
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sig_alarm;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGALRM, &sa, NULL);
+	
+	timer.it_interval.tv_sec = interval / 1000;
+	timer.it_interval.tv_usec = (interval % 1000) * 1000;
+	timer.it_value = timer.it_interval;
+	if (setitimer(ITIMER_REAL, &timer, NULL) < 0) {
+		syslog(LOG_ERR, "Cannot start flush timer: %s", strerror(errno));
+	}
+}
+
+/**
+ * Flush all logfiles with buffered lines, in Redis mode the queued commands
+ */
+void flushAllFiles(void) {
+	struct handlebuffer * handle;
+	
+	if (config.opt_redis) {
+		redisSinkFlush();
+		return;
+	}
+	for (handle = lru_newest; handle != NULL; handle = handle->older) {
+		flushLogfile(handle);
+	}
+}
+
+/**
+ * Flush all logfiles once the flush timer expired and shut down once SIGINT
+ * or SIGTERM arrived, called by every receive loop before it blocks again.
+ * With a writer thread the files are its own, it does both itself.
+ */
+void checkFlush(void) {
+	if (writer) {
+		return;
+	}
+	if (stopping) {
+		shutdownServer();
+	}
+	if (!flushing) {
+		return;
+	}
+	flushing = 0;
+	flushAllFiles();
+}
+
+/**
+ * Log received datagram, used by all receive engines
+ * @param const char * buffer payload, not NUL terminated
+ * @param size_t len length of payload
+ * @param struct sockaddr_in * cliAddr sender of the datagram
+ */
+void handleDatagram(const char *buffer, size_t len, struct sockaddr_in *cliAddr) {
+	struct timespec received;
+	queueSlot *slot;
+	const char *source;
+	size_t sourcelen;
+	
+	timestampClock(&received);
+	
+	// hand over to the writer thread, everything else is done there
+	if (queue != NULL) {
+		// the arrival time is read before spscReserve() may wait for a slot
+		slot = spscReserve(queue);
+		slot->time = received;
+		slot->from = *cliAddr;
+		slot->len = len;
+		memcpy(slot->data, buffer, len);
+		spscPublish(queue);
+		return;
+	}
+	
+	source = addressFormat(cliAddr, &sourcelen);
+	logMessage(buffer, len, source, sourcelen, &received);
+	checkStatistics();
+}
+
+/**
+ * Writer side of whichever queue is in use: i-th oldest ready slot
+ * @param unsigned int i
+ * @return queueSlot * or NULL
+ */
+static inline queueSlot * writerPeek(unsigned int i) {
+	return mqueue != NULL ? mpscPeek(mqueue, i) : spscPeek(queue, i);
+}
+
+/**
+ * Give the n oldest slots back to the receive threads
+ * @param unsigned int n
+ */
+static inline void writerRelease(unsigned int n) {
+	if (mqueue != NULL) {
+		mpscRelease(mqueue, n);
+	} else {
+		spscRelease(queue, n);
+	}
+}
+
+/**
+ * Sleep until the receive threads queue more
+ */
+static inline void writerWait(void) {
+	if (mqueue != NULL) {
+		mpscWait(mqueue);
+	} else {
+		spscWait(queue);
+	}
+}
+
+/**
+ * Number of queued datagrams
+ * @return unsigned int
+ */
+static inline unsigned int writerDepth(void) {
+	return mqueue != NULL ? mpscDepth(mqueue) : spscDepth(queue);
+}
+
+/**
+ * Writer thread, logs the datagrams queued by the receive threads
+ * 
+ * Takes up to QUEUE_BATCH ready slots at a time, strictly in queue order, so
+ * lines of every logfile are written in the order they were queued. The
+ * slots go back to the receive threads together.
+ * 
+ * All signals are handled here, so SIGALRM wakes up the thread for flushing
+ * and SIGINT/SIGTERM let it write what is queued before shutting down.
+ * @param void * arg unused
+ * @return void *
+ */
+void * writerThread(void *arg) {
+	queueSlot *slot;
+	const char *source;
+	size_t sourcelen;
+	unsigned int n, left = 0;
+	int draining = 0;
+	
+	while (1) {
+		if (flushing) {
+			flushing = 0;
+			flushAllFiles();
+		}
+		
+		// on shutdown write what is queued by now, then quit
+		if (stopping && !draining) {
+			draining = 1;
+			left = writerDepth();
+		}
+		if (draining && left == 0) {
+			shutdownServer();
+		}
+		
+		for (n = 0; n < QUEUE_BATCH && (slot = writerPeek(n)) != NULL; n++) {
+			source = addressFormat(&slot->from, &sourcelen);
+			logMessage(slot->data, slot->len, source, sourcelen, &slot->time);
+			checkStatistics();
+		}
+		if (n == 0) {
+			writerWait();
+			continue;
+		}
+		writerRelease(n);
+		stat_queue_drains++;
+		stat_queue_drained += n;
+		if (draining) {
+			left = (n < left) ? left - n : 0;
+		}
+	}
+	
+	return NULL;
+}
+
+/**
+ * Start writer thread and leave all signals to it
+ */
+void startWriter(void) {
+	pthread_t thread;
+	sigset_t signals;
+	
+	if (config.opt_receivers > 1) {
+		// a whole receive batch is claimed at once, it has to fit
+		mqueue = mpscCreate(config.queue_slots > config.opt_batch ? config.queue_slots : config.opt_batch);
+	} else {
+		queue = spscCreate(config.queue_slots);
+	}
+	if (queue == NULL && mqueue == NULL) {
+		syslog(LOG_ERR, "Cannot allocate queue of %u datagrams", config.queue_slots);
+		exit(EXIT_FAILURE);
+	}
+	writer = 1;
+	if (pthread_create(&thread, NULL, writerThread, NULL) != 0) {
+		syslog(LOG_ERR, "Cannot start writer thread");
+		exit(EXIT_FAILURE);
+	}
+	
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGHUP);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	sigaddset(&signals, SIGALRM);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+}
+
+/**
+ * Queue a received batch for the writer thread with one claim
+ * @param char (*buffers)[BUF]
+ * @param struct mmsghdr * msgs
+ * @param struct sockaddr_in * cliAddrs
+ * @param unsigned int n
+ * @param const struct timespec * received Arrival, read before the claim may wait
+ */
+static void publishBatch(char (*buffers)[BUF], struct mmsghdr *msgs, struct sockaddr_in *cliAddrs, unsigned int n, const struct timespec *received) {
+	queueSlot *slot;
+	unsigned int pos, i;
+	
+	pos = mpscClaim(mqueue, n);
+	for (i = 0; i < n; i++) {
+		slot = mpscSlot(mqueue, pos + i);
+		slot->time = *received;
+		slot->from = cliAddrs[i];
+		slot->len = msgs[i].msg_len;
+		memcpy(slot->data, buffers[i], slot->len);
+	}
+	mpscPublish(mqueue, pos, n);
+}
+
+/**
+ * Additional receive thread, signals stay blocked as in the starting thread
+ * @param void * arg socket
+ * @return void *
+ */
+void * receiverThread(void *arg) {
+	serverLoopBatch((int) (intptr_t) arg);
+	
+	return NULL;
+}
+
+/**
+ * Start receive threads 1 to n - 1 on the further sockets of the worker,
+ * the calling thread is receiver 0
+ */
+void startReceivers(void) {
+	pthread_t thread;
+	unsigned int i;
+	
+	for (i = 1; i < config.opt_receivers; i++) {
+		if (pthread_create(&thread, NULL, receiverThread, (void *) (intptr_t) socks[worker_id * config.opt_receivers + i]) != 0) {
+			syslog(LOG_ERR, "Cannot start receive thread %u", i);
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+/**
+ * The batched UDP receiver loop, pulling up to config.opt_batch datagrams per
+ * recvmmsg() call into preallocated buffers. The number of slots offered to
+ * the kernel grows while batches come back full and shrinks when they are
+ * mostly empty. With several receive threads each runs this loop on its own
+ * socket and queues whole batches.
+ * @param int s socket
+ */
+void serverLoopBatch(int s) {
+	char (*buffers)[BUF];
+	struct mmsghdr *msgs;
+	struct iovec *iovecs;
+	struct sockaddr_in *cliAddrs;
+	struct timespec received;
+	unsigned int i, vlen = 1;
+	int n;
+
+	buffers = malloc(config.opt_batch * sizeof(*buffers));
+	msgs = calloc(config.opt_batch, sizeof(struct mmsghdr));
+	iovecs = calloc(config.opt_batch, sizeof(struct iovec));
+	cliAddrs = calloc(config.opt_batch, sizeof(struct sockaddr_in));
+	if (buffers == NULL || msgs == NULL || iovecs == NULL || cliAddrs == NULL) {
+		syslog(LOG_ERR, "Cannot allocate receive buffers");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < config.opt_batch; i++) {
+		iovecs[i].iov_base = buffers[i];
+		iovecs[i].iov_len = BUF;
+		msgs[i].msg_hdr.msg_iov = &iovecs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &cliAddrs[i];
+	}
+
+	while (1) {
+		checkFlush();
+		
+		for (i = 0; i < vlen; i++) {
+			msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		}
+
+		// block for the first datagram, then take whatever else is queued
+		n = recvmmsg(s, msgs, vlen, MSG_WAITFORONE, NULL);
+		if (n <= 0) {
+			if (n < 0 && errno != EINTR) {
+				syslog(LOG_ERR, "cannot receive data");
+			}
+			continue;
+		}
+		__atomic_add_fetch(&stat_batches, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&stat_batch_messages, n, __ATOMIC_RELAXED);
+
+		if (mqueue != NULL) {
+			timestampClock(&received);
+			publishBatch(buffers, msgs, cliAddrs, n, &received);
+		} else {
+			for (i = 0; i < (unsigned int) n; i++) {
+				handleDatagram(buffers[i], msgs[i].msg_len, &cliAddrs[i]);
+			}
+		}
+
+		// adapt batch size to load
+		if ((unsigned int) n == vlen && vlen < config.opt_batch) {
+			vlen = (vlen * 2 < config.opt_batch) ? vlen * 2 : config.opt_batch;
+		} else if ((unsigned int) n < vlen / 4) {
+			vlen /= 2;
+		}
+	}
 }
 
 /**
@@ -459,26 +1219,162 @@ void serverLoop(void) {
 	char buffer[BUF];
 	struct sockaddr_in cliAddr;
 	
-	while (1) {
-		// init buffer
-		memset (buffer, 0, BUF);
+	// timers are not inherited by forked workers, every worker starts its own
+	startFlushTimer();
+	
+	if (config.opt_writers > 1) {
+		poolStart(config.opt_writers, config.maxnames);
+		pooled = 1;
+	}
+	
+	if (config.queue_slots > 0) {
+		startWriter();
+	}
+	
+	if (config.opt_receivers > 1) {
+		startReceivers();
+		serverLoopBatch(sock);
+		return;
+	}
+	
+	if (config.opt_engine == ENGINE_URING) {
+		if (uringInit(sock) == 0) {
+			uringLoop();
+		} else {
+			syslog(LOG_INFO, "io_uring not available, falling back to recvfrom");
+		}
+	} else if (config.opt_engine == ENGINE_PACKET) {
+		if (packetInit(sock) == 0) {
+			packetLoop();
+		} else {
+			syslog(LOG_INFO, "packet ring not available, falling back to recvfrom");
+		}
+	} else if (config.opt_engine == ENGINE_XDP) {
+		if (xdpInit(worker_id) == 0) {
+			xdpLoop();
+		} else {
+			syslog(LOG_INFO, "AF_XDP socket not available, falling back to recvfrom");
+		}
+	}
 
+	if (config.opt_batch > 1) {
+		serverLoopBatch(sock);
+		return;
+	}
+
+	while (1) {
+		checkFlush();
+		
 		// receive messages
 		len = sizeof(cliAddr);
 		n = recvfrom(sock, buffer, BUF, 0, (struct sockaddr *) &cliAddr, (socklen_t *) &len );
 		if (n < 0) {
-		   syslog(LOG_ERR, "cannot receive data");
-		   continue;
+			if (errno != EINTR) {
+				syslog(LOG_ERR, "cannot receive data");
+			}
+			continue;
 		}
+		stat_batches++;
+		stat_batch_messages++;
 
 		// output message
-		logMessage(buffer, inet_ntoa(cliAddr.sin_addr), ntohs(cliAddr.sin_port));
-		
-		// If optional statistics logging is set log every n'th message
-		if (config.opt_statistics > 0 && stat_messages_handled % config.opt_statistics == 0) {
-			statistics();
+		handleDatagram(buffer, n, &cliAddr);
+	}
+}
+
+/**
+ * Signal handler of the worker supervisor, passes signals on to all workers
+ * @param int signo
+ */
+static void sig_forward(int signo) {
+	unsigned int i;
+	
+	if (signo != SIGHUP) {
+		terminating = 1;
+	}
+	for (i = 0; i < config.opt_workers; i++) {
+		if (workers[i] > 0) {
+			kill(workers[i], signo);
+		}
+	}
+}
+
+/**
+ * Fork worker process with its own socket, handlebuffer and statistics
+ * @param unsigned int id
+ */
+void startWorker(unsigned int id) {
+	unsigned int i;
+	pid_t pid;
+	
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0) {
+		syslog(LOG_ERR, "Cannot fork worker %u", id);
+		return;
+	} else if (pid > 0) {
+		workers[id] = pid;
+		return;
+	}
+	
+	// worker keeps only the sockets of its receive threads
+	worker_id = id;
+	sock = socks[id * config.opt_receivers];
+	for (i = 0; i < nsocks; i++) {
+		if (i / config.opt_receivers != id) {
+			close(socks[i]);
+		}
+	}
+	
+	signal(SIGHUP, sig_hup);
+	setStopHandler(SIGINT, sig_int);
+	setStopHandler(SIGTERM, sig_term);
+	
+	serverLoop();
+	exit(EXIT_SUCCESS);
+}
+
+/**
+ * Start all workers and restart them if they die, until terminated by signal
+ */
+void superviseWorkers(void) {
+	unsigned int i;
+	pid_t pid;
+	
+	for (i = 0; i < config.opt_workers; i++) {
+		startWorker(i);
+	}
+	
+	signal(SIGHUP, sig_forward);
+	signal(SIGINT, sig_forward);
+	signal(SIGTERM, sig_forward);
+	
+	while (1) {
+		pid = wait(NULL);
+		if (pid < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		for (i = 0; i < config.opt_workers; i++) {
+			if (workers[i] == pid) {
+				workers[i] = 0;
+				if (!terminating) {
+					syslog(LOG_ERR, "worker %u died, restarting", i);
+					sleep(1);
+				}
+				// signal may have arrived while sleeping
+				if (!terminating) {
+					startWorker(i);
+				}
+			}
 		}
 	}
+	
+	syslog(LOG_INFO, "exiting");
+	closelog();
+	exit(EXIT_SUCCESS);
 }
 
 /**
@@ -490,6 +1386,7 @@ void serverLoop(void) {
  */
 int main(int argc, char** argv) {
 	readOptions(argc, argv);
+	timestampInit(config.opt_precision);
 	
 	// start statistics timer
 	stat_start_time = time(NULL);
@@ -498,7 +1395,11 @@ int main(int argc, char** argv) {
 	initServer();
   
 	// start server loop (endless)
-	serverLoop();
+	if (config.opt_workers > 1) {
+		superviseWorkers();
+	} else {
+		serverLoop();
+	}
   
 	return EXIT_SUCCESS;
 }
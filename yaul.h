@@ -19,32 +19,79 @@ extern "C" {
 
 // Struct for buffering opened filehandles
 typedef struct handlebuffer {
-	char name[NAMELENGTH];
-	FILE * filehandle;
+	unsigned int id;			// logname id, the name is interned[id].name
+	int fd;
+	struct uringFile * ring;	// writes go through io_uring if set
+	char * buffer;				// whole lines not yet written
+	size_t used;
+	struct handlebuffer * newer;	// LRU list of open files
+	struct handlebuffer * older;
 } handlebuffer;
 
+// Log line handed to the sinks, both parts are not NUL terminated
+typedef struct logline {
+	const char * prefix;		// "<time> [<address>:<port>] "
+	size_t prefixlen;
+	const char * body;			// message, points into the receive buffer
+	size_t bodylen;
+} logline;
+
+// Redis list key of a logname for the current day
+typedef struct rediskey {
+	char key[NAMELENGTH + DATE_LENGTH];	// "<logname>.<day>"
+	size_t len;					// 0 until first used
+	unsigned int expiring;		// connection the EXPIREAT of the day was sent on, 0 = not yet
+} rediskey;
+
 /* Function Prototypes */
-static int cmpKeys(void *a, void *b);
-void closeRandomFile(void);
+void initHandlePool(void);
+static handlebuffer * handleAlloc(void);
+static void handleFree(handlebuffer *handle);
+void closeLeastRecentFile(void);
 void closeAllFiles(void);
+void resetLognames(void);
 void shutdownServer(void);
 static void sig_hup(int signo);
 static void sig_int(int signo);
 static void sig_term(int signo);
+static int setStopHandler(int signo, void (*handler)(int));
+static void sig_forward(int signo);
+static void sig_alarm(int signo);
 void print_version(void);
 void print_usage(void);
 void daemonize_server(void);
-void openRedis(void);
+int openSocket(void);
+void attachSteering(void);
 void initServer(void);
-FILE * openLogfile(char *name);
-void logMessageFile(char *name, char *message);
-void logMessageRedis(char *name, char *message);
-void logMessage(char *buffer, char *address, unsigned int port);
+handlebuffer * openLogfile(unsigned int id);
+ssize_t writeFull(int fd, const struct iovec *iov, int iovcnt);
+void writeLogfile(handlebuffer *handle, const struct iovec *iov, int iovcnt);
+void flushLogfile(handlebuffer *handle);
+void closeLogfile(handlebuffer *handle);
+void logMessageFile(unsigned int id, logline *line);
+void logMessageRedis(unsigned int id, logline *line);
+void logMessage(const char *buffer, size_t len, const char *source, size_t sourcelen, const struct timespec *received);
 void statistics(void);
+void startFlushTimer(void);
+void flushAllFiles(void);
+void checkFlush(void);
+void handleDatagram(const char *buffer, size_t len, struct sockaddr_in *cliAddr);
+static inline queueSlot * writerPeek(unsigned int i);
+static inline void writerRelease(unsigned int n);
+static inline void writerWait(void);
+static inline unsigned int writerDepth(void);
+void * writerThread(void *arg);
+void startWriter(void);
+static void publishBatch(char (*buffers)[BUF], struct mmsghdr *msgs, struct sockaddr_in *cliAddrs, unsigned int n, const struct timespec *received);
+void * receiverThread(void *arg);
+void startReceivers(void);
+void serverLoopBatch(int s);
 void serverLoop(void);
+void startWorker(unsigned int id);
+void superviseWorkers(void);
 
 /* Debug helpers */
-void hashtableDump(struct hashtable *h);
+void handlesDump(void);
 
 #ifdef	__cplusplus
 }